@@ -0,0 +1,139 @@
+#include "COS.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+COS::COS(Model* model, size_t N, double L) : m_model(model), m_N(N), m_L(L) {
+    if (N == 1)
+        throw std::invalid_argument("COS: at least two terms are needed");
+    if (L <= 0.0)
+        throw std::invalid_argument("COS: L must be positive");
+}
+
+void COS::expansion(double T, double& a, double& b, vector<double>& weights) const {
+
+    const Model& model = *m_model;
+
+    // cumulants of the log return from ln cf(u) = i c1 u - c2 u^2/2 - i c3 u^3/6
+    // + c4 u^4/24 + ..., by finite differences at the origin
+    const double h = 0.05;
+    std::complex<double> psi_1 = log(model.cf(h, T));
+    std::complex<double> psi_2 = log(model.cf(2.0 * h, T));
+    double c1 = psi_1.imag() / h;
+    double c2 = -2.0 * psi_1.real() / (h * h);
+    double c4 = 2.0 * (psi_2.real() - 4.0 * psi_1.real()) / (h * h * h * h);
+    double width = m_L * sqrt(std::max(c2, 0.0) + sqrt(std::abs(c4)));
+    if (!(width > 0.0))
+        throw std::invalid_argument("COS: degenerate distribution");
+
+    // weights of the expansion (the first term of the series counts for half);
+    // without a fixed number of terms, the series stops once the modulus of
+    // the characteristic function stays below the tolerance (the later terms
+    // are bounded by it)
+    const size_t N_max = 1 << 16, N_min = 64, N_tail = 16, N_widen = 8;
+    const double tol = 1e-12;
+    const std::complex<double> i(0.0, 1.0);
+    for (size_t widen = 0; ; widen++) {
+        a = c1 - width;
+        b = c1 + width;
+        weights.clear();
+        for (size_t k = 0, small = 0; m_N ? k < m_N : k < N_max && (k < N_min || small < N_tail); k++) {
+            double u = k * M_PI / (b - a);
+            std::complex<double> phi = model.cf(u, T);
+            weights.push_back((phi * exp(-i * u * a)).real());
+            small = std::abs(phi) < tol ? small + 1 : 0;
+        }
+        weights[0] *= 0.5;
+        if (m_N || widen == N_widen)
+            break;
+
+        // the mass beyond the range is folded back into it: without a fixed
+        // number of terms, widen the range until the expanded density f at
+        // both ends is negligible (the cumulants miss the rare large jumps of
+        // short maturities and the left tail of Heston); (b - a) f(a) and
+        // (b - a) f(b) are twice the sums of the weights, alternated for b
+        double f_a = 0.0, f_b = 0.0;
+        for (size_t k = 0; k < weights.size(); k++) {
+            f_a += weights[k];
+            f_b += k % 2 ? -weights[k] : weights[k];
+        }
+        if (2.0 * std::max(std::abs(f_a), std::abs(f_b)) <= tol)
+            break;
+        width *= 1.25;
+    }
+}
+
+Vec<double> COS::price(double S_0, double T, double DF, const Vec<double>& K, bool call) const {
+
+    double a, b;
+    vector<double> weights;
+    expansion(T, a, b, weights);
+
+    // forward of the model (for the put-call parity)
+    const Model& model = *m_model;
+    double F = S_0 * exp((model["r"] - model["d"]) * T);
+
+    // strike independent factors of the coefficients
+    size_t N = weights.size();
+    vector<double> u(N), inv_u(N), inv_1pu2(N);
+    for (size_t k = 0; k < N; k++) {
+        u[k] = k * M_PI / (b - a);
+        inv_u[k] = k == 0 ? 0.0 : 1.0 / u[k];
+        inv_1pu2[k] = 1.0 / (1.0 + u[k] * u[k]);
+    }
+
+    Vec<double> prices(K.size());
+    for (size_t j = 0; j < K.size(); j++) {
+
+        // puts are integrated (bounded payoff), calls follow from the parity:
+        // payoff (K - S_0 e^z)^+ is positive for z below c = ln(K/S_0)
+        double c = std::min(log(K[j] / S_0), b);
+        double put = 0.0;
+        if (c > a) {
+            // cos and sin of k theta by rotation, theta = pi (c - a) / (b - a)
+            double theta = M_PI * (c - a) / (b - a);
+            double cos_t = cos(theta), sin_t = sin(theta);
+            double cos_k = 1.0, sin_k = 0.0;
+            double e_a = exp(a), e_c = exp(c);
+            // integrals of cos(u (z - a)) and e^z cos(u (z - a)) over [a, c]
+            put = weights[0] * (K[j] * (c - a) - S_0 * (e_c - e_a));
+            for (size_t k = 1; k < N; k++) {
+                // next angle
+                double cos_next = cos_k * cos_t - sin_k * sin_t;
+                sin_k = sin_k * cos_t + cos_k * sin_t;
+                cos_k = cos_next;
+
+                double psi = sin_k * inv_u[k];
+                double chi = (cos_k * e_c - e_a + u[k] * sin_k * e_c) * inv_1pu2[k];
+                put += weights[k] * (K[j] * psi - S_0 * chi);
+            }
+            put *= 2.0 / (b - a) * DF;
+            put = std::max(put, 0.0);
+        }
+        prices[j] = call ? put + DF * (F - K[j]) : put;
+    }
+
+    return prices;
+}
+
+Matrix<double> COS::surface(double S_0, const Vec<double>& T, const Vec<double>& DF,
+    const Vec<double>& K, bool call) const {
+
+    if (DF.size() != T.size())
+        throw std::invalid_argument("COS::surface: one discount factor per maturity is needed");
+
+    Matrix<double> prices(K.size(), T.size());
+    for (size_t i = 0; i < T.size(); i++)
+        prices[i] = price(S_0, T[i], DF[i], K, call);
+    return prices;
+}
+
+double COS::price(const Option& option, double S_0, double T, double DF) const {
+
+    bool call = dynamic_cast<const EU_Call*>(&option) != nullptr;
+    if (!call && dynamic_cast<const EU_Put*>(&option) == nullptr)
+        throw std::invalid_argument("COS: only EU_Call and EU_Put are supported");
+
+    return price(S_0, T, DF, Vec<double>(1, option["K"]), call)[0];
+}
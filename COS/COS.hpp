@@ -0,0 +1,52 @@
+#ifndef COS_HPP
+#define COS_HPP
+
+#include <complex>
+#include <vector>
+
+#include "model.hpp"
+#include "option.hpp"
+#include "matrix.hpp"
+#include "vec.hpp"
+
+using std::vector;
+
+// Fourier-cosine (COS) pricer of European options for models with a known
+// characteristic function: the density of the log return is expanded on a
+// cosine series whose coefficients come from the characteristic function, which
+// is evaluated once per maturity and shared by all the strikes
+class COS {
+
+private:
+    // model (must implement Model::cf)
+    Model* m_model;
+    // number of terms of the expansion (0 = until the characteristic function
+    // is negligible)
+    size_t m_N;
+    // width of the truncation range (in units of the cumulants)
+    double m_L;
+
+    // expansion of the density of the log return for maturity T: truncation
+    // range [a, b] and weights Re(cf(u_k) e^{-i u_k a}) (first one halved)
+    void expansion(double T, double& a, double& b, vector<double>& weights) const;
+
+public:
+    // constructor (by default the number of terms follows from the decay of
+    // the characteristic function over the truncation range: wide ranges and
+    // peaked densities need thousands of terms)
+    COS(Model* model, size_t N = 0, double L = 10.0);
+
+    // prices of European calls (or puts) on a set of strikes for one maturity
+    Vec<double> price(double S_0, double T, double DF, const Vec<double>& K,
+        bool call = true) const;
+
+    // price surface: one column per maturity, one row per strike
+    Matrix<double> surface(double S_0, const Vec<double>& T, const Vec<double>& DF,
+        const Vec<double>& K, bool call = true) const;
+
+    // price of an EU_Call or EU_Put (e.g. as a control variate for MC::price)
+    double price(const Option& option, double S_0, double T, double DF) const;
+
+};
+
+#endif // !#ifndef COS_HPP
@@ -0,0 +1,77 @@
+// checks of the COS pricer against closed forms and reference values
+
+#include "COS.hpp"
+
+#include <cmath>
+#include <iostream>
+
+static size_t failures = 0;
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        std::cout << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// largest absolute difference between the COS prices of a strip of strikes and
+// a closed form
+template <class F>
+static double error(const COS& cos, double S_0, double T, double DF, bool call, F exact) {
+    Vec<double> K(61);
+    for (size_t i = 0; i < K.size(); i++)
+        K[i] = 70.0 + i;
+    Vec<double> prices = cos.price(S_0, T, DF, K, call);
+    double worst = 0.0;
+    for (size_t i = 0; i < K.size(); i++)
+        worst = std::max(worst, std::abs(prices[i] - exact(K[i])));
+    return worst;
+}
+
+// Black-Scholes and Merton against their closed forms
+static void check_closed_forms() {
+
+    BlackScholes black_scholes = BlackScholes(0.05, 0.2, 0.01);
+    Merton merton = Merton(0.05, 0.2, 0.5, -0.1, 0.15);
+
+    for (double T : {0.05, 0.25, 1.0, 5.0}) {
+        for (bool call : {true, false}) {
+            string name = string(call ? "calls" : "puts") + " T=" + std::to_string(T);
+            double DF = exp(-0.05 * T);
+            double e = error(COS(&black_scholes), 100.0, T, DF, call,
+                [&](double K) { return black_scholes.european(100.0, K, T, call); });
+            check(e <= 1e-12, "Black-Scholes " + name + ": error " + std::to_string(e));
+            e = error(COS(&merton), 100.0, T, DF, call,
+                [&](double K) { return merton.european(100.0, K, T, call); });
+            check(e <= 1e-12, "Merton " + name + ": error " + std::to_string(e));
+        }
+    }
+}
+
+// Heston test case of Andersen (2008), which needs thousands of terms
+static void check_heston() {
+
+    Heston heston = Heston(0.0, 0.5, 0.04, 1.0, -0.9, 0.04);
+    COS cos = COS(&heston);
+    double price = cos.price(100.0, 10.0, 1.0, Vec<double>(1, 100.0))[0];
+    check(std::abs(price - 13.0847) <= 1e-4, "Heston call " + std::to_string(price)
+        + " matches the reference 13.0847");
+
+    // the surface and the option overload give the same prices
+    EU_Put put = EU_Put(100.0);
+    double parity = cos.price(put, 100.0, 10.0, 1.0) - price;
+    check(std::abs(parity) <= 1e-9, "Heston put-call parity at the forward");
+    Matrix<double> surface = cos.surface(100.0, Vec<double>(1, 10.0), Vec<double>(1, 1.0),
+        Vec<double>(1, 100.0));
+    check(surface[0][0] == price, "surface and strip agree");
+}
+
+int main() {
+    check_closed_forms();
+    check_heston();
+    if (failures)
+        std::cout << failures << " check(s) failed" << std::endl;
+    else
+        std::cout << "all checks passed" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,247 @@
+#include "LSM.hpp"
+#include "scheduler.hpp"
+
+#include <cmath>
+#include <future>
+#include <stdexcept>
+
+vector<double> solve_spd(vector<double> A, vector<double> b) {
+
+    size_t n = b.size();
+    if (A.size() != n * n)
+        throw std::invalid_argument("solve_spd: wrong size");
+
+    // equilibrate the system (unit diagonal) to tame the conditioning of the basis
+    vector<double> scale(n, 0.0);
+    for (size_t i = 0; i < n; i++)
+        scale[i] = A[i*n + i] > 0.0 ? 1.0 / sqrt(A[i*n + i]) : 0.0;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++)
+            A[i*n + j] *= scale[i] * scale[j];
+        b[i] *= scale[i];
+    }
+
+    // in place Cholesky factorization (lower triangle), dropping the directions
+    // whose pivot vanishes (rank deficient regressions, e.g. few paths in the money)
+    const double tol = 1e-12;
+    vector<bool> dropped(n, false);
+    for (size_t j = 0; j < n; j++) {
+        double pivot = A[j*n + j];
+        for (size_t k = 0; k < j; k++)
+            pivot -= A[j*n + k] * A[j*n + k];
+        if (scale[j] == 0.0 || pivot <= tol) {
+            dropped[j] = true;
+            for (size_t i = j; i < n; i++)
+                A[i*n + j] = 0.0;
+            continue;
+        }
+        double L_jj = sqrt(pivot);
+        A[j*n + j] = L_jj;
+        for (size_t i = j + 1; i < n; i++) {
+            double sum = A[i*n + j];
+            for (size_t k = 0; k < j; k++)
+                sum -= A[i*n + k] * A[j*n + k];
+            A[i*n + j] = sum / L_jj;
+        }
+    }
+
+    // forward substitution (L y = b)
+    for (size_t i = 0; i < n; i++) {
+        if (dropped[i]) {
+            b[i] = 0.0;
+            continue;
+        }
+        for (size_t k = 0; k < i; k++)
+            b[i] -= A[i*n + k] * b[k];
+        b[i] /= A[i*n + i];
+    }
+    // backward substitution (L^T x = y)
+    for (size_t i = n; i-- > 0; ) {
+        if (dropped[i]) {
+            b[i] = 0.0;
+            continue;
+        }
+        for (size_t k = i + 1; k < n; k++)
+            b[i] -= A[k*n + i] * b[k];
+        b[i] /= A[i*n + i];
+    }
+
+    // undo the equilibration
+    for (size_t i = 0; i < n; i++)
+        b[i] *= scale[i];
+
+    return b;
+}
+
+LSM::LSM(Model* model, EarlyExercise* option, size_t degree, Basis basis,
+    ThreadPool* pool, size_t block, std::mt19937::result_type seed)
+    : m_model(model), m_option(option), m_basis(basis), m_degree(degree),
+      m_block(block), m_seed(seed), m_pool(pool ? *pool : ThreadPool::shared()) {
+    if (m_block == 0)
+        throw std::invalid_argument("block must be positive");
+}
+
+void LSM::basis(const double* x, size_t n, double* phi) const {
+
+    size_t p = m_degree + 1;
+    for (size_t i = 0; i < n; i++) {
+        double* row = phi + i*p;
+        if (m_basis == Basis::Monomial) {
+            row[0] = 1.0;
+            for (size_t k = 1; k < p; k++)
+                row[k] = row[k-1] * x[i];
+        } else {
+            // weighted Laguerre polynomials (three term recurrence)
+            double w = exp(-0.5 * x[i]);
+            row[0] = w;
+            if (p > 1)
+                row[1] = w * (1.0 - x[i]);
+            for (size_t k = 1; k + 1 < p; k++)
+                row[k+1] = ((2.0*k + 1.0 - x[i]) * row[k] - k * row[k-1]) / (k + 1.0);
+        }
+    }
+}
+
+Matrix<double> LSM::simulate(size_t N_sim, size_t N_steps, double S_0, double T) {
+
+    double dt = T/N_steps;
+    const Model& model = *m_model;
+    Matrix<double> S(N_sim, N_steps+1, S_0);
+
+    model.prepare(T, N_steps);
+
+    // each block of paths is simulated on its own stream (thread independent)
+    vector<std::future<void>> tasks;
+    for (size_t first = 0, index = 0; first < N_sim; first += m_block, index++) {
+        size_t n = std::min(m_block, N_sim - first);
+        tasks.push_back(m_pool.submit([&, first, index, n]() {
+            Model::seed(m_seed, {index});
+
+            State X = model.init(n, S_0);
+            for (size_t j = 0; j < N_steps; j++) {
+                model.step(X, j * dt, dt);
+                for (size_t i = 0; i < n; i++)
+                    S[j+1][first + i] = X[0][i];
+            }
+        }));
+    }
+    for (auto& task : tasks)
+        task.get();
+
+    return S;
+}
+
+Vec<double> LSM::cashflows(const Matrix<double>& S, const Vec<double>& DF) {
+
+    size_t N_sim = S.rows();
+    size_t N_steps = S.columns() - 1;
+
+    // discount factors are aligned on maturity (the last one)
+    if (DF.size() < N_steps)
+        throw std::invalid_argument("Not enough discount factors");
+    auto disc = [&DF, N_steps](size_t i) { return DF[DF.size() - 1 - (N_steps - i)]; };
+
+    // regress on the spot relative to the initial one (keeps the basis well scaled)
+    double S_ref = S[0][0] > 0.0 ? S[0][0] : 1.0;
+    size_t p = m_degree + 1;
+    size_t N_blocks = (N_sim + m_block - 1) / m_block;
+
+    // exercise at maturity
+    vector<size_t> dates = m_option->exercise_dates(N_steps);
+    Vec<double> V = disc(N_steps) * m_option->intrinsic(S[N_steps]);
+
+    // backward induction on the other exercise dates
+    for (size_t d = dates.size() - 1; d-- > 0; ) {
+        size_t k = dates[d];
+        const Vec<double>& S_k = S[k];
+        Vec<double> h = m_option->intrinsic(S_k);
+        double DF_k = disc(k);
+
+        // normal equations of the in-the-money paths, accumulated block by block
+        // (A is p x p followed by b, merged in block order for reproducibility);
+        // the basis is kept per block for the exercise decision
+        vector<vector<double>> partial(N_blocks, vector<double>(p*p + p, 0.0));
+        vector<vector<size_t>> itm(N_blocks);
+        vector<vector<double>> phi(N_blocks);
+        vector<std::future<void>> tasks;
+        for (size_t blk = 0; blk < N_blocks; blk++) {
+            tasks.push_back(m_pool.submit([&, blk]() {
+                size_t first = blk * m_block;
+                size_t n = std::min(m_block, N_sim - first);
+                vector<double> x;
+                x.reserve(n);
+                itm[blk].reserve(n);
+                for (size_t i = first; i < first + n; i++) {
+                    if (h[i] > 0.0) {
+                        itm[blk].push_back(i);
+                        x.push_back(S_k[i] / S_ref);
+                    }
+                }
+                phi[blk].resize(x.size() * p);
+                basis(x.data(), x.size(), phi[blk].data());
+
+                double* A = partial[blk].data();
+                double* b = A + p*p;
+                for (size_t j = 0; j < x.size(); j++) {
+                    const double* row = &phi[blk][j*p];
+                    double y = V[itm[blk][j]];
+                    for (size_t r = 0; r < p; r++) {
+                        for (size_t c = r; c < p; c++)
+                            A[r*p + c] += row[r] * row[c];
+                        b[r] += row[r] * y;
+                    }
+                }
+            }));
+        }
+        for (auto& task : tasks)
+            task.get();
+
+        vector<double> A(p*p, 0.0), b(p, 0.0);
+        for (const auto& part : partial) {
+            for (size_t r = 0; r < p; r++) {
+                for (size_t c = r; c < p; c++)
+                    A[r*p + c] += part[r*p + c];
+                b[r] += part[p*p + r];
+            }
+        }
+        // nothing to decide if no path is in the money
+        if (A[0] == 0.0)
+            continue;
+        for (size_t r = 0; r < p; r++)
+            for (size_t c = 0; c < r; c++)
+                A[r*p + c] = A[c*p + r];
+        vector<double> beta = solve_spd(A, b);
+
+        // exercise where the intrinsic value beats the estimated continuation
+        tasks.clear();
+        for (size_t blk = 0; blk < N_blocks; blk++) {
+            tasks.push_back(m_pool.submit([&, blk]() {
+                for (size_t j = 0; j < itm[blk].size(); j++) {
+                    const double* row = &phi[blk][j*p];
+                    double continuation = 0.0;
+                    for (size_t r = 0; r < p; r++)
+                        continuation += row[r] * beta[r];
+                    size_t i = itm[blk][j];
+                    if (DF_k * h[i] > continuation)
+                        V[i] = DF_k * h[i];
+                }
+            }));
+        }
+        for (auto& task : tasks)
+            task.get();
+    }
+
+    return V;
+}
+
+map<string, double> LSM::price(Vec<double> DF, double S_0, double T, size_t N_sim,
+    size_t N_steps) {
+
+    // simulate the paths and apply the regressed exercise policy
+    Matrix<double> S = simulate(N_sim, N_steps, S_0, T);
+    Vec<double> V = cashflows(S, DF);
+
+    PathStats stats;
+    stats.add(V);
+    return stats.result();
+}
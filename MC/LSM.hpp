@@ -0,0 +1,67 @@
+#ifndef LSM_HPP
+#define LSM_HPP
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "model.hpp"
+#include "option.hpp"
+#include "matrix.hpp"
+#include "pool.hpp"
+
+using std::map;
+using std::string;
+using std::vector;
+
+// polynomial basis for the regression of the continuation value
+enum class Basis { Monomial, Laguerre };
+
+// solve the small symmetric positive semi-definite system A x = b (A is n x n,
+// row major); the system is equilibrated and directions with a vanishing
+// Cholesky pivot are dropped (their coefficient is set to zero)
+vector<double> solve_spd(vector<double> A, vector<double> b);
+
+// Longstaff-Schwartz (least-squares Monte Carlo) engine for early exercise options
+class LSM {
+
+private:
+    // model to use for the simulation
+    Model* m_model;
+    // option to price
+    EarlyExercise* m_option;
+    // basis of the regression (degree + 1 functions)
+    Basis m_basis;
+    size_t m_degree;
+    // number of paths per block (unit of work and of the reductions)
+    size_t m_block;
+    // seed of the simulation (each block of paths gets its own stream)
+    std::mt19937::result_type m_seed;
+    // workers for the simulation, the regressions and the exercise decisions
+    // (borrowed)
+    ThreadPool& m_pool;
+
+    // evaluate the basis at x for a block of paths (n x (degree + 1), row major)
+    void basis(const double* x, size_t n, double* phi) const;
+
+public:
+    // constructor (the work runs on pool, the shared one by default)
+    LSM(Model* model, EarlyExercise* option, size_t degree = 3,
+        Basis basis = Basis::Laguerre, ThreadPool* pool = nullptr, size_t block = 4096,
+        std::mt19937::result_type seed = 42);
+
+    // simulate the paths (N_sim x N_steps+1) in parallel blocks
+    Matrix<double> simulate(size_t N_sim, size_t N_steps, double S_0, double T);
+
+    // discounted cashflow of each path under the regressed exercise policy
+    // (DF holds the discount factors of the steps, the last one being maturity)
+    Vec<double> cashflows(const Matrix<double>& S, const Vec<double>& DF);
+
+    // compute the price and IC at 95%
+    map<string, double> price(Vec<double> DF, double S_0, double T, size_t N_sim,
+        size_t N_steps);
+
+};
+
+#endif // !#ifndef LSM_HPP
@@ -1,4 +1,8 @@
 #include "MC.hpp"
+#include "scheduler.hpp"
+
+#include <cmath>
+#include <limits>
 
 // simulation
 Matrix<double> MC::simulate(size_t N_sim, size_t N_steps, double S_0, double T) {
@@ -10,14 +14,18 @@ Matrix<double> MC::simulate(size_t N_sim, size_t N_steps, double S_0, double T)
 
     // create the matrix to hold the paths (N_sim x N_steps+1)
     Matrix<double> S(N_sim, N_steps+1);
+    // let the model precompute its data for the grid
+    model.prepare(T, N_steps);
 
-    // set the first column to S_0
-    S[0] = Vec<double>(N_sim, S_0);
+    // set the first column to S_0 (the other factors stay in the state)
+    State X = model.init(N_sim, S_0);
+    S[0] = X[0];
 
     // simulate the paths for each column
     for (size_t i = 0; i<N_steps; ++i){
         // simulate the next step
-        S[i+1] = model.simulate(S[i], dt);
+        model.step(X, i * dt, dt);
+        S[i+1] = X[0];
     }
 
     return S;
@@ -55,7 +63,56 @@ map<string, double> MC::compute_IC_and_mean(Vec<double> DF) const {
     };
 }
 
+Vec<double> MC::stream(const PathOption& option, const Vec<double>& DF, double S_0,
+    double T, size_t N_sim, size_t N_steps) const {
+
+    // discount factors are aligned on maturity (the last one)
+    if (DF.size() < N_steps)
+        throw std::invalid_argument("Not enough discount factors");
+    size_t offset = DF.size() - N_steps;
+
+    double dt = T/N_steps;
+    const Model &model = *m_model;
+    size_t K = option.state_size();
+
+    Vec<double> payoff(N_sim);
+    vector<double> state(m_block * K);
+    model.prepare(T, N_steps);
+
+    for (size_t first = 0; first < N_sim; first += m_block) {
+        size_t n = std::min(m_block, N_sim - first);
+
+        // only the current state and the previous spot of the block are alive
+        State X = model.init(n, S_0);
+        Vec<double> S_prev;
+        option.init_block(state.data(), &X[0][0], n);
+        for (size_t i = 1; i <= N_steps; ++i) {
+            S_prev = X[0];
+            model.step(X, (i - 1) * dt, dt);
+            option.update_block(state.data(), &S_prev[0], &X[0][0], n,
+                {i, i * dt, dt, DF[offset + i - 1]});
+        }
+        option.value_block(state.data(), &X[0][0], n, DF[DF.size()-1], &payoff[first]);
+    }
+
+    return payoff;
+}
+
+Vec<double> MC::payoffs(Vec<double> DF, double S_0, double T, size_t N_sim, size_t N_steps) {
+    // path functionals never need the whole paths
+    if (const PathOption* option = dynamic_cast<const PathOption*>(m_option))
+        return stream(*option, DF, S_0, T, N_sim, N_steps);
+    return m_option->payoff(simulate(N_sim, N_steps, S_0, T), DF);
+}
+
 map<string, double> MC::price(Vec<double> DF, double S_0, double T, size_t N_sim, size_t N_steps) {
+    // path functionals are accumulated during the simulation
+    if (const PathOption* option = dynamic_cast<const PathOption*>(m_option)) {
+        PathStats stats;
+        stats.add(stream(*option, DF, S_0, T, N_sim, N_steps));
+        return stats.result();
+    }
+
     // simulate the paths if necessary
     if (m_result.rows() != N_sim || m_result.columns() != N_steps + 1){
         m_result = simulate(N_sim, N_steps, S_0, T);
@@ -65,3 +122,116 @@ map<string, double> MC::price(Vec<double> DF, double S_0, double T, size_t N_sim
     return compute_IC_and_mean(DF);
 }
 
+
+map<string, double> MC::price(Vec<double> DF, double S_0, double T, size_t N_sim,
+    size_t N_steps, const Option& control, double control_price) {
+
+    // both payoffs on the same paths (path functionals see the real time grid)
+    Matrix<double> S = simulate(N_sim, N_steps, S_0, T);
+    auto payoff = [&S, &DF, T](const Option& option) {
+        if (const PathOption* path_option = dynamic_cast<const PathOption*>(&option))
+            return path_option->payoff(S, DF, T);
+        return option.payoff(S, DF);
+    };
+    Vec<double> X = payoff(*m_option);
+    Vec<double> C = payoff(control);
+
+    // optimal coefficient beta = cov(X, C) / var(C)
+    double mean_X = X.mean();
+    double mean_C = C.mean();
+    double cov = 0.0, var_C = 0.0;
+    for (size_t i = 0; i < N_sim; i++) {
+        cov += (X[i] - mean_X) * (C[i] - mean_C);
+        var_C += (C[i] - mean_C) * (C[i] - mean_C);
+    }
+    double beta = var_C > 0.0 ? cov / var_C : 0.0;
+
+    // controlled payoffs
+    PathStats stats;
+    stats.add(X - beta * (C - control_price));
+    map<string, double> results = stats.result();
+    results["beta"] = beta;
+    return results;
+}
+
+Vec<double> MC::weighted_payoffs(const BlackScholes& model, const Vec<double>& DF,
+    double S_0, double T, size_t N_sim, size_t N_steps, double shift, Vec<double>* Z) const {
+
+    double dt = T/N_steps;
+    // shift of each normal (the terminal normal is their sum over sqrt(N_steps))
+    double theta = shift / sqrt(double(N_steps));
+
+    // paths under the shifted measure
+    Matrix<double> S(N_sim, N_steps+1);
+    Vec<double> Z_sum(N_sim, 0.0);
+    S[0] = Vec<double>(N_sim, S_0);
+    for (size_t i = 0; i < N_steps; ++i)
+        S[i+1] = model.simulate(S[i], dt, theta, Z_sum);
+
+    // payoffs times the likelihood ratios
+    const PathOption* path_option = dynamic_cast<const PathOption*>(m_option);
+    Vec<double> payoff = path_option ? path_option->payoff(S, DF, T) : m_option->payoff(S, DF);
+    for (size_t i = 0; i < N_sim; i++)
+        payoff[i] *= exp(theta * (0.5 * N_steps * theta - Z_sum[i]));
+
+    if (Z)
+        *Z = Z_sum / sqrt(double(N_steps));
+    return payoff;
+}
+
+map<string, double> MC::price_IS(Vec<double> DF, double S_0, double T, size_t N_sim,
+    size_t N_steps, size_t N_pilot) {
+
+    const BlackScholes* model = dynamic_cast<const BlackScholes*>(m_model);
+    if (!model)
+        throw std::invalid_argument("MC::price_IS: only the Black-Scholes model is supported");
+    if (N_pilot < 100)
+        throw std::invalid_argument("MC::price_IS: at least 100 pilot paths are needed");
+
+    // pilot run at a shift: number of paths that pay and cross-entropy update
+    // (mean terminal normal under the payoff-weighted measure, which tends to
+    // the mean of the zero variance density)
+    Vec<double> Z;
+    auto pilot = [&](double shift, size_t& hits) {
+        Vec<double> Y = weighted_payoffs(*model, DF, S_0, T, N_pilot, N_steps, shift, &Z);
+        double sum = 0.0, sum_Z = 0.0;
+        hits = 0;
+        for (size_t i = 0; i < N_pilot; i++) {
+            hits += Y[i] != 0.0;
+            sum += std::abs(Y[i]);
+            sum_Z += std::abs(Y[i]) * Z[i];
+        }
+        return sum > 0.0 ? sum_Z / sum : shift;
+    };
+
+    // first shift (by increasing size) whose pilot pays often enough: deep out
+    // of the money payoffs are never reached without a shift
+    size_t min_hits = N_pilot / 100;
+    double shift = 0.0;
+    size_t hits;
+    double update = pilot(0.0, hits);
+    for (double size = 0.5; hits < min_hits && size <= 8.0; size += 0.5) {
+        size_t hits_up, hits_down;
+        double update_up = pilot(size, hits_up);
+        double update_down = pilot(-size, hits_down);
+        hits = std::max(hits_up, hits_down);
+        shift = hits_up >= hits_down ? size : -size;
+        update = hits_up >= hits_down ? update_up : update_down;
+    }
+
+    // cross-entropy iterations
+    for (size_t k = 0; k < 10 && hits >= min_hits; k++) {
+        double previous = shift;
+        shift = update;
+        if (std::abs(shift - previous) < 0.01)
+            break;
+        update = pilot(shift, hits);
+    }
+
+    // main run under the selected measure
+    PathStats stats;
+    stats.add(weighted_payoffs(*model, DF, S_0, T, N_sim, N_steps, shift));
+    map<string, double> results = stats.result();
+    results["shift"] = shift;
+    return results;
+}
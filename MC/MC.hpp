@@ -15,10 +15,24 @@ private:
     Option* m_option;
     // result of the simulation
     Matrix<double> m_result;
+    // number of paths simulated together by the streaming payoffs (the state of
+    // a block stays in cache for the whole path)
+    static constexpr size_t m_block = 4096;
 
     // compute the IC and mean (helper function)
     map<string, double> compute_IC_and_mean(Vec<double> DF) const;
 
+    // payoffs weighted by the likelihood ratio of paths whose terminal normal
+    // is shifted by shift (the terminal normals are stored in Z, if given)
+    Vec<double> weighted_payoffs(const BlackScholes& model, const Vec<double>& DF,
+        double S_0, double T, size_t N_sim, size_t N_steps, double shift,
+        Vec<double>* Z = nullptr) const;
+
+    // simulate the paths block by block, accumulating a streaming payoff
+    // (O(N_sim) memory instead of O(N_sim x N_steps))
+    Vec<double> stream(const PathOption& option, const Vec<double>& DF, double S_0,
+        double T, size_t N_sim, size_t N_steps) const;
+
 public:
 
     // constructor
@@ -27,10 +41,26 @@ public:
     // return the result of the simulation
     Matrix<double> simulate(size_t N_sim, size_t N_steps, double S_0, double T);
 
+    // discounted payoff of each path (streamed for path functionals)
+    Vec<double> payoffs(Vec<double> DF, double S_0, double T, size_t N_sim, size_t N_steps);
+
     // compute the price and IC at 95%
     map<string, double> price(Vec<double> DF, double S_0, double T, size_t N_sim, 
         size_t N_steps);
 
+    // compute the price and IC at 95% with importance sampling (Black-Scholes
+    // only): the normals are shifted so that the paths reach the payoff region;
+    // the shift is found by pilot runs of N_pilot paths (cross-entropy updates
+    // started from the first shift whose pilot pays often enough) and returned
+    // as "shift" (in standard deviations of the terminal normal)
+    map<string, double> price_IS(Vec<double> DF, double S_0, double T, size_t N_sim,
+        size_t N_steps, size_t N_pilot = 1000);
+
+    // compute the price and IC at 95% using as control variate an option with a
+    // known price, evaluated on the same paths (the coefficient is estimated)
+    map<string, double> price(Vec<double> DF, double S_0, double T, size_t N_sim,
+        size_t N_steps, const Option& control, double control_price);
+
 };
 
 #endif // !#ifndef MC_HPP
@@ -0,0 +1,182 @@
+#include "scheduler.hpp"
+#include "MC.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <stdexcept>
+
+using clock_type = std::chrono::steady_clock;
+
+void PathStats::add(const Vec<double>& payoff) {
+    // Welford update
+    for (size_t i = 0; i < payoff.size(); i++) {
+        n++;
+        double delta = payoff[i] - mean;
+        mean += delta / n;
+        M2 += delta * (payoff[i] - mean);
+    }
+}
+
+void PathStats::merge(const PathStats& other) {
+    // Chan et al. pairwise update
+    if (other.n == 0)
+        return;
+    size_t N = n + other.n;
+    double delta = other.mean - mean;
+    mean += delta * other.n / N;
+    M2 += other.M2 + delta * delta * n * other.n / N;
+    n = N;
+}
+
+map<string, double> PathStats::result() const {
+
+    if (n < 2)
+        throw std::invalid_argument("PathStats::result: at least two paths are needed");
+
+    double var = M2 / (n - 1);
+
+    return {
+        {"mean", mean},
+        {"lb", mean - 1.96 * sqrt(var / n)},
+        {"ub", mean + 1.96 * sqrt(var / n)},
+        {"var", var}
+    };
+}
+
+Scheduler::Scheduler(size_t N_threads, size_t block_cost, std::mt19937::result_type seed,
+    ThreadPool* pool)
+    : m_pool(pool ? *pool : ThreadPool::shared()), m_threads(N_threads),
+      m_block_cost(block_cost), m_seed(seed) {
+    if (m_threads == 0)
+        m_threads = m_pool.size();
+    if (m_block_cost == 0)
+        throw std::invalid_argument("block_cost must be positive");
+}
+
+double Scheduler::utilization() const {
+    return m_utilization;
+}
+
+bool Scheduler::next(vector<Queue>& queues, size_t worker, Block& block) {
+
+    // own deque first (most recently dealt block)
+    {
+        Queue& own = queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.blocks.empty()) {
+            block = own.blocks.back();
+            own.blocks.pop_back();
+            return true;
+        }
+    }
+
+    // steal the oldest block of the other workers, starting from the next one
+    for (size_t k = 1; k < queues.size(); k++) {
+        Queue& victim = queues[(worker + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.blocks.empty()) {
+            block = victim.blocks.front();
+            victim.blocks.pop_front();
+            return true;
+        }
+    }
+
+    // blocks never spawn other blocks, so empty deques mean we are done
+    return false;
+}
+
+vector<map<string, double>> Scheduler::price(const vector<Trade>& trades) {
+
+    // split each trade into blocks of paths of roughly m_block_cost path steps
+    vector<vector<Block>> blocks(trades.size());
+    for (size_t k = 0; k < trades.size(); k++) {
+        const Trade& trade = trades[k];
+        if (trade.N_sim < 2 || trade.N_steps == 0)
+            throw std::invalid_argument("Scheduler::price: N_sim must be at least 2 and N_steps positive");
+        size_t paths = std::max<size_t>(2, m_block_cost / trade.N_steps);
+        for (size_t first = 0, index = 0; first < trade.N_sim; first += paths, index++)
+            blocks[k].push_back({k, index, std::min(paths, trade.N_sim - first)});
+    }
+
+    // deal the blocks to the workers round robin, interleaving the trades so that
+    // every worker starts with a mix of cheap and expensive work
+    size_t N_threads = m_threads;
+    vector<Queue> queues(N_threads);
+    size_t dealt = 0;
+    for (size_t index = 0; ; index++) {
+        bool any = false;
+        for (size_t k = 0; k < trades.size(); k++) {
+            if (index < blocks[k].size()) {
+                queues[dealt++ % N_threads].blocks.push_back(blocks[k][index]);
+                any = true;
+            }
+        }
+        if (!any)
+            break;
+    }
+
+    // partial statistics of every block (merged in block order at the end)
+    vector<vector<PathStats>> partial(trades.size());
+    for (size_t k = 0; k < trades.size(); k++)
+        partial[k].resize(blocks[k].size());
+
+    // busy time of each worker (seconds)
+    vector<double> busy(N_threads, 0.0);
+    // first error raised by a block (rethrown on the calling thread)
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto work = [&](size_t worker) {
+        Block block;
+        while (next(queues, worker, block)) {
+            clock_type::time_point start = clock_type::now();
+            try {
+                const Trade& trade = trades[block.trade];
+                // each block has its own stream, so the result does not depend
+                // on which worker ran it
+                Model::seed(m_seed, {block.trade, block.index});
+
+                MC mc = MC(trade.model, trade.option);
+                partial[block.trade][block.index].add(
+                    mc.payoffs(trade.DF, trade.S_0, trade.T, block.N_sim, trade.N_steps));
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+            busy[worker] += std::chrono::duration<double>(clock_type::now() - start).count();
+        }
+    };
+
+    clock_type::time_point start = clock_type::now();
+    vector<std::future<void>> workers;
+    for (size_t i = 1; i < N_threads; i++)
+        workers.push_back(m_pool.submit([&work, i]() { work(i); }));
+    // the calling thread is worker 0
+    work(0);
+    for (auto& worker : workers)
+        worker.get();
+    double wall = std::chrono::duration<double>(clock_type::now() - start).count();
+
+    double total = 0.0;
+    for (double b : busy)
+        total += b;
+    m_utilization = wall > 0.0 ? total / (wall * N_threads) : 0.0;
+
+    if (error)
+        std::rethrow_exception(error);
+
+    // merge the partial statistics in a fixed order (deterministic results)
+    vector<map<string, double>> results;
+    results.reserve(trades.size());
+    for (size_t k = 0; k < trades.size(); k++) {
+        PathStats stats;
+        for (const PathStats& p : partial[k])
+            stats.merge(p);
+        results.push_back(stats.result());
+    }
+
+    return results;
+}
@@ -0,0 +1,94 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "model.hpp"
+#include "option.hpp"
+#include "pool.hpp"
+#include "vec.hpp"
+
+using std::map;
+using std::string;
+using std::vector;
+
+// a trade of a pricing batch (the model and the option are not owned)
+struct Trade {
+    Model* model;
+    Option* option;
+    Vec<double> DF;
+    double S_0;
+    double T;
+    size_t N_sim;
+    size_t N_steps;
+};
+
+// running statistics of the payoffs of a set of paths (mergeable)
+struct PathStats {
+    // number of paths, mean and sum of squared deviations
+    size_t n = 0;
+    double mean = 0.0;
+    double M2 = 0.0;
+
+    // add the payoffs of a block of paths
+    void add(const Vec<double>& payoff);
+    // merge the statistics of another set of paths
+    void merge(const PathStats& other);
+    // mean and IC at 95% (same keys as MC::price)
+    map<string, double> result() const;
+};
+
+// work-stealing scheduler for batches of trades: each trade is split into
+// blocks of paths of roughly equal cost (N_sim x N_steps), blocks are dealt to
+// per-worker deques and idle workers steal from the others
+class Scheduler {
+
+private:
+    // a block of paths of a trade
+    struct Block {
+        size_t trade;
+        size_t index;
+        size_t N_sim;
+    };
+
+    // deque of blocks owned by a worker (the owner pops from the back,
+    // thieves steal from the front)
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Block> blocks;
+    };
+
+    // pool running the workers (borrowed)
+    ThreadPool& m_pool;
+    // number of workers (the calling thread is one of them)
+    size_t m_threads;
+    // target cost of a block (number of simulated path steps)
+    size_t m_block_cost;
+    // seed of the batch (each block gets its own stream derived from it)
+    std::mt19937::result_type m_seed;
+    // fraction of the wall time the workers spent on blocks (last batch)
+    double m_utilization = 0.0;
+
+    // take a block from the own deque or steal one from the others
+    static bool next(vector<Queue>& queues, size_t worker, Block& block);
+
+public:
+    // constructor (the workers run on pool, the shared one by default; 0
+    // threads means one per worker of the pool)
+    explicit Scheduler(size_t N_threads = 0, size_t block_cost = 1 << 18,
+        std::mt19937::result_type seed = 42, ThreadPool* pool = nullptr);
+
+    // price a batch of trades (one result per trade, in order)
+    vector<map<string, double>> price(const vector<Trade>& trades);
+
+    // utilization of the workers during the last batch
+    double utilization() const;
+
+};
+
+#endif // !#ifndef SCHEDULER_HPP
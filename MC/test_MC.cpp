@@ -0,0 +1,189 @@
+// checks of the Monte Carlo engines against closed forms and reference values
+
+#include "MC.hpp"
+#include "LSM.hpp"
+
+#include <cmath>
+#include <iostream>
+
+static size_t failures = 0;
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        std::cout << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// standard normal distribution function
+static double N(double x) {
+    return 0.5 * erfc(-x * M_SQRT1_2);
+}
+
+// continuously monitored up-and-out call under Black-Scholes (B > K), as the
+// european call minus the up-and-in call (Hull, Options, Futures and Other
+// Derivatives)
+static double up_and_out_call(double S, double K, double B, double r, double sigma,
+    double T) {
+    double v = sigma * sqrt(T);
+    double lambda = (r + 0.5 * sigma * sigma) / (sigma * sigma);
+    double x1 = log(S / B) / v + lambda * v;
+    double y = log(B * B / (S * K)) / v + lambda * v;
+    double y1 = log(B / S) / v + lambda * v;
+    double d1 = log(S / K) / v + 0.5 * v + r * T / v;
+    double call = S * N(d1) - K * exp(-r * T) * N(d1 - v);
+    double up_in = S * N(x1) - K * exp(-r * T) * N(x1 - v)
+        - S * pow(B / S, 2.0 * lambda) * (N(-y) - N(-y1))
+        + K * exp(-r * T) * pow(B / S, 2.0 * lambda - 2.0) * (N(-y + v) - N(-y1 + v));
+    return call - up_in;
+}
+
+// Brownian bridge barriers: no monitoring bias on a coarse grid
+static void check_barrier() {
+
+    double r = 0.05, sigma = 0.2, T = 1.0;
+    size_t N_sim = 200000, N_steps = 10;
+    BlackScholes model = BlackScholes(r, sigma);
+    Vec<double> DF(N_steps);
+    for (size_t i = 0; i < N_steps; i++)
+        DF[i] = exp(-r * T * (i + 1) / N_steps);
+
+    Barrier out = Barrier(Barrier::UpOut, true, 100.0, 120.0, sigma);
+    Barrier in = Barrier(Barrier::UpIn, true, 100.0, 120.0, sigma);
+    double exact = up_and_out_call(100.0, 100.0, 120.0, r, sigma, T);
+
+    // streamed by the engine
+    Model::seed(1);
+    MC mc = MC(&model, &out);
+    map<string, double> result = mc.price(DF, 100.0, T, N_sim, N_steps);
+    check(result["lb"] <= exact && exact <= result["ub"], "up-and-out call "
+        + std::to_string(result["mean"]) + " matches the closed form " + std::to_string(exact));
+
+    // on stored paths: the grid must be given, in and out sum to the european
+    Model::seed(2);
+    Matrix<double> S = mc.simulate(N_sim, N_steps, 100.0, T);
+    Vec<double> stored = out.payoff(S, DF, T);
+    Vec<double> sum = stored + in.payoff(S, DF, T);
+    double mean = stored.mean(), half = 1.96 * sqrt(stored.var() / N_sim);
+    check(std::abs(mean - exact) <= half, "up-and-out call on stored paths "
+        + std::to_string(mean) + " matches the closed form");
+    bool parity = true;
+    for (size_t i = 0; i < N_sim; i++)
+        parity = parity && std::abs(sum[i] - DF[N_steps-1] * std::max(S[N_steps][i] - 100.0, 0.0)) <= 1e-12;
+    check(parity, "up-and-in plus up-and-out is the european call on every path");
+
+    bool thrown = false;
+    try {
+        const Option& option = out;
+        option.payoff(S, DF);
+    } catch (const std::logic_error&) {
+        thrown = true;
+    }
+    check(thrown, "barrier payoff without the time grid throws");
+}
+
+// Merton: paths against the closed form, and a number of draws per path that
+// does not depend on the parameters (common random numbers)
+static void check_merton() {
+
+    Merton model = Merton(0.05, 0.2, 3.0, -0.2, 0.3);
+    size_t N_sim = 200000, N_steps = 20;
+    Vec<double> DF(N_steps);
+    for (size_t i = 0; i < N_steps; i++)
+        DF[i] = exp(-0.05 * (i + 1.0) / N_steps);
+
+    EU_Call call = EU_Call(100.0);
+    Model::seed(3);
+    MC mc = MC(&model, &call);
+    map<string, double> result = mc.price(DF, 100.0, 1.0, N_sim, N_steps);
+    double exact = model.european(100.0, 100.0, 1.0);
+    check(result["lb"] <= exact && exact <= result["ub"], "Merton call "
+        + std::to_string(result["mean"]) + " matches the closed form " + std::to_string(exact));
+
+    // the generator ends at the same position whatever the intensity (the
+    // next draw, read through a Black-Scholes step, is the same)
+    Merton rare = Merton(0.05, 0.2, 0.01, -0.2, 0.3);
+    BlackScholes probe = BlackScholes(0.0, 0.2);
+    double after[2];
+    const Merton* models[2] = {&model, &rare};
+    for (size_t m = 0; m < 2; m++) {
+        Model::seed(5);
+        models[m]->simulate(Vec<double>(5000, 100.0), 0.5);
+        after[m] = probe.simulate(Vec<double>(1, 100.0), 1.0)[0];
+    }
+    check(after[0] == after[1], "Merton draws do not depend on the intensity");
+}
+
+// local volatility: a flat surface is Black-Scholes, and the prepared slices
+// give the same paths as the surface sampled at every step
+static void check_local_vol() {
+
+    double r = 0.05, T = 1.0;
+    size_t N_sim = 100000, N_steps = 50;
+    Vec<double> DF(N_steps);
+    for (size_t i = 0; i < N_steps; i++)
+        DF[i] = exp(-r * T * (i + 1) / N_steps);
+
+    LocalVol flat = LocalVol(r, [](double t, double S) { return 0.2; }, 20.0, 500.0);
+    BlackScholes black_scholes = BlackScholes(r, 0.2);
+    EU_Call call = EU_Call(100.0);
+    Model::seed(4);
+    MC mc = MC(&flat, &call);
+    map<string, double> result = mc.price(DF, 100.0, T, N_sim, N_steps);
+    double exact = black_scholes.european(100.0, 100.0, T);
+    check(result["lb"] <= exact && exact <= result["ub"], "flat local volatility call "
+        + std::to_string(result["mean"]) + " matches Black-Scholes " + std::to_string(exact));
+
+    // a surface depending on time and spot, stepped by the engine (prepared)
+    // and by hand on a fresh model (not prepared)
+    LocalVol::Surface skew = [](double t, double S) { return 0.2 + 0.1 * t - 0.0005 * (S - 100.0); };
+    LocalVol prepared = LocalVol(r, skew, 20.0, 500.0);
+    LocalVol fresh = LocalVol(r, skew, 20.0, 500.0);
+    Model::seed(6);
+    Matrix<double> S = MC(&prepared, &call).simulate(1000, N_steps, 100.0, T);
+    Model::seed(6);
+    State X = fresh.init(1000, 100.0);
+    double dt = T / N_steps;
+    for (size_t i = 0; i < N_steps; i++)
+        fresh.step(X, i * dt, dt);
+    bool identical = true;
+    for (size_t i = 0; i < 1000; i++)
+        identical = identical && X[0][i] == S[N_steps][i];
+    check(identical, "prepared local volatility slices give the sampled paths");
+}
+
+// Longstaff-Schwartz on the american put of their table 1 (S_0 = 36, K = 40,
+// r = 0.06, sigma = 0.2, T = 1, 50 exercise dates), against the finite
+// difference value 4.478 of the same contract
+static void check_lsm() {
+
+    BlackScholes model = BlackScholes(0.06, 0.2);
+    AM_Put put = AM_Put(40.0);
+    size_t N_sim = 100000, N_steps = 50;
+    Vec<double> DF(N_steps);
+    for (size_t i = 0; i < N_steps; i++)
+        DF[i] = exp(-0.06 * (i + 1.0) / N_steps);
+
+    LSM lsm = LSM(&model, &put);
+    map<string, double> result = lsm.price(DF, 36.0, 1.0, N_sim, N_steps);
+    check(result["lb"] <= 4.478 && 4.478 <= result["ub"], "LSM american put "
+        + std::to_string(result["mean"]) + " matches the reference 4.478");
+
+    // the same paths with the monomial basis
+    LSM monomial = LSM(&model, &put, 3, Basis::Monomial);
+    double price = monomial.price(DF, 36.0, 1.0, N_sim, N_steps)["mean"];
+    check(std::abs(price - result["mean"]) <= 0.01, "monomial basis "
+        + std::to_string(price) + " agrees with the Laguerre basis");
+}
+
+int main() {
+    check_barrier();
+    check_merton();
+    check_local_vol();
+    check_lsm();
+    if (failures)
+        std::cout << failures << " check(s) failed" << std::endl;
+    else
+        std::cout << "all checks passed" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+#include "PDE.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+PDE::PDE(Model* model, Option* option, size_t N_space, size_t N_time, size_t rannacher,
+    double width, double concentration)
+    : m_model(model), m_option(option), m_space(N_space), m_time(N_time),
+      m_rannacher(rannacher), m_width(width), m_concentration(concentration) {
+    if (!supports(model, option))
+        throw std::invalid_argument("PDE: only Black-Scholes vanilla options with a positive strike are supported");
+    if (N_space < 4 || N_time < 1)
+        throw std::invalid_argument("PDE: at least 4 space intervals and 1 time step are needed");
+    if (concentration <= 0.0 || width <= 0.0)
+        throw std::invalid_argument("PDE: width and concentration must be positive");
+}
+
+bool PDE::supports(const Model* model, const Option* option) {
+    bool vanilla = dynamic_cast<const EU_Call*>(option) != nullptr ||
+        dynamic_cast<const EU_Put*>(option) != nullptr ||
+        dynamic_cast<const AM_Call*>(option) != nullptr ||
+        dynamic_cast<const AM_Put*>(option) != nullptr;
+    // the grid is scaled by the strike, which must be positive
+    return dynamic_cast<const BlackScholes*>(model) != nullptr && vanilla &&
+        (*option)["K"] > 0.0;
+}
+
+void PDE::solve() {
+    size_t n = m_diag.size();
+    // forward sweep
+    m_scratch[0] = m_upper[0] / m_diag[0];
+    m_rhs[0] /= m_diag[0];
+    for (size_t j = 1; j < n; j++) {
+        double denominator = m_diag[j] - m_lower[j] * m_scratch[j-1];
+        m_scratch[j] = m_upper[j] / denominator;
+        m_rhs[j] = (m_rhs[j] - m_lower[j] * m_rhs[j-1]) / denominator;
+    }
+    // back substitution
+    for (size_t j = n - 1; j-- > 0; )
+        m_rhs[j] -= m_scratch[j] * m_rhs[j+1];
+}
+
+map<string, double> PDE::price(double S_0, double T, size_t N_steps) {
+
+    // the time grid is scaled by T (also rejects NaN)
+    if (!(T > 0.0))
+        throw std::invalid_argument("PDE: T must be positive");
+
+    // retrieve the parameters
+    const Model& model = *m_model;
+    double r = model["r"];
+    double sigma = model["sigma"];
+    double d = model["d"];
+    double K = (*m_option)["K"];
+
+    bool call = dynamic_cast<const EU_Call*>(m_option) || dynamic_cast<const AM_Call*>(m_option);
+    const EarlyExercise* early = dynamic_cast<const EarlyExercise*>(m_option);
+    double phi = call ? 1.0 : -1.0;
+
+    // grid: S_j = K + c sinh(xi_j) with xi uniform, from 0 to a few standard
+    // deviations above the spot (nodes concentrate around the strike)
+    size_t M = m_space;
+    double S_max = std::max(S_0, K) * exp(m_width * sigma * sqrt(T) + std::abs(r - d) * T);
+    double c = m_concentration * K;
+    double xi_min = asinh(-K / c);
+    double xi_max = asinh((S_max - K) / c);
+    vector<double> S(M + 1);
+    for (size_t j = 0; j <= M; j++)
+        S[j] = K + c * sinh(xi_min + (xi_max - xi_min) * j / M);
+    S[0] = 0.0;
+
+    // spatial operator L V_j = l_j V_{j-1} + c_j V_j + u_j V_{j+1} (non uniform
+    // central differences), constant in time
+    vector<double> l(M + 1, 0.0), ctr(M + 1, 0.0), u(M + 1, 0.0);
+    for (size_t j = 1; j < M; j++) {
+        double h_m = S[j] - S[j-1];
+        double h_p = S[j+1] - S[j];
+        double a = 0.5 * sigma * sigma * S[j] * S[j];
+        double mu = (r - d) * S[j];
+        l[j] = 2.0 * a / (h_m * (h_m + h_p)) - mu * h_p / (h_m * (h_m + h_p));
+        ctr[j] = -2.0 * a / (h_m * h_p) + mu * (h_p - h_m) / (h_m * h_p) - r;
+        u[j] = 2.0 * a / (h_p * (h_m + h_p)) + mu * h_m / (h_p * (h_m + h_p));
+    }
+
+    // terminal condition
+    vector<double> V(M + 1), intrinsic(M + 1);
+    for (size_t j = 0; j <= M; j++)
+        intrinsic[j] = std::max(phi * (S[j] - K), 0.0);
+    V = intrinsic;
+
+    // boundary values at time to maturity tau
+    auto boundary = [&](double tau, double S_j) {
+        double value = std::max(phi * (S_j * exp(-d * tau) - K * exp(-r * tau)), 0.0);
+        if (early)
+            value = std::max(value, std::max(phi * (S_j - K), 0.0));
+        return value;
+    };
+
+    // segments of time to maturity between exercise dates (a single one for
+    // european options); american options are exercised on the steps of the
+    // simulation grid, as in LSM, so that both engines price the same contract
+    vector<double> stops = {0.0};
+    if (early) {
+        vector<size_t> dates = early->exercise_dates(N_steps);
+        for (size_t k = dates.size() - 1; k-- > 0; )
+            stops.push_back(T - dates[k] * T / N_steps);
+    }
+    stops.push_back(T);
+
+    m_lower.assign(M + 1, 0.0);
+    m_diag.assign(M + 1, 1.0);
+    m_upper.assign(M + 1, 0.0);
+    m_rhs.assign(M + 1, 0.0);
+    m_scratch.assign(M + 1, 0.0);
+
+    // one theta step of length dt ending at time to maturity tau
+    auto step = [&](double theta, double dt, double tau) {
+        for (size_t j = 1; j < M; j++) {
+            m_lower[j] = -theta * dt * l[j];
+            m_diag[j] = 1.0 - theta * dt * ctr[j];
+            m_upper[j] = -theta * dt * u[j];
+            m_rhs[j] = V[j] + (1.0 - theta) * dt * (l[j] * V[j-1] + ctr[j] * V[j] + u[j] * V[j+1]);
+        }
+        // Dirichlet rows
+        m_lower[0] = m_upper[0] = 0.0;
+        m_diag[0] = 1.0;
+        m_rhs[0] = boundary(tau, S[0]);
+        m_lower[M] = m_upper[M] = 0.0;
+        m_diag[M] = 1.0;
+        m_rhs[M] = boundary(tau, S[M]);
+        solve();
+        V.swap(m_rhs);
+    };
+
+    for (size_t s = 0; s + 1 < stops.size(); s++) {
+        double length = stops[s+1] - stops[s];
+        size_t N_time = std::max<size_t>(1, static_cast<size_t>(std::ceil(m_time * length / T)));
+        double dt = length / N_time;
+        double tau = stops[s];
+        for (size_t n = 0; n < N_time; n++) {
+            if (n < m_rannacher) {
+                // Rannacher: two implicit Euler half steps
+                step(1.0, 0.5 * dt, tau + 0.5 * dt);
+                step(1.0, 0.5 * dt, tau + dt);
+            } else {
+                step(0.5, dt, tau + dt);
+            }
+            tau += dt;
+        }
+        // exercise at the date closing the segment (not at inception)
+        if (early && s + 2 < stops.size())
+            for (size_t j = 0; j <= M; j++)
+                V[j] = std::max(V[j], intrinsic[j]);
+    }
+
+    // quadratic interpolation on the three nodes around the spot
+    size_t j = std::upper_bound(S.begin(), S.end(), S_0) - S.begin();
+    j = std::min(std::max<size_t>(j, 1), M - 1);
+    double x0 = S[j-1], x1 = S[j], x2 = S[j+1];
+    double w0 = (x0 - x1) * (x0 - x2);
+    double w1 = (x1 - x0) * (x1 - x2);
+    double w2 = (x2 - x0) * (x2 - x1);
+    double price = V[j-1] * (S_0 - x1) * (S_0 - x2) / w0
+        + V[j] * (S_0 - x0) * (S_0 - x2) / w1
+        + V[j+1] * (S_0 - x0) * (S_0 - x1) / w2;
+    double delta = V[j-1] * (2.0 * S_0 - x1 - x2) / w0
+        + V[j] * (2.0 * S_0 - x0 - x2) / w1
+        + V[j+1] * (2.0 * S_0 - x0 - x1) / w2;
+    double gamma = 2.0 * (V[j-1] / w0 + V[j] / w1 + V[j+1] / w2);
+
+    return {
+        {"mean", price},
+        {"lb", price},
+        {"ub", price},
+        {"var", 0.0},
+        {"delta", delta},
+        {"gamma", gamma}
+    };
+}
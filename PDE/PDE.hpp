@@ -0,0 +1,56 @@
+#ifndef PDE_HPP
+#define PDE_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "model.hpp"
+#include "option.hpp"
+
+using std::map;
+using std::string;
+using std::vector;
+
+// finite difference engine for one factor models: Crank-Nicolson in time
+// (with Rannacher start-up steps to damp the payoff kink) on a grid in S
+// concentrated around the strike; price, delta and gamma come from the grid
+class PDE {
+
+private:
+    // model and option to price
+    Model* m_model;
+    Option* m_option;
+    // number of space intervals and of time steps
+    size_t m_space;
+    size_t m_time;
+    // number of Crank-Nicolson steps replaced by two implicit Euler half steps
+    size_t m_rannacher;
+    // width of the grid (standard deviations) and concentration around the strike
+    double m_width;
+    double m_concentration;
+
+    // workspace of the tridiagonal solver (reused across time steps)
+    vector<double> m_lower, m_diag, m_upper, m_rhs, m_scratch;
+
+    // solve the tridiagonal system of the workspace in place (Thomas algorithm,
+    // the solution overwrites m_rhs)
+    void solve();
+
+public:
+    // constructor
+    PDE(Model* model, Option* option, size_t N_space = 500, size_t N_time = 250,
+        size_t rannacher = 2, double width = 6.0, double concentration = 0.1);
+
+    // true if the engine can price the option under the model (vanillas with
+    // a positive strike under Black-Scholes)
+    static bool supports(const Model* model, const Option* option);
+
+    // price, delta and gamma (keys mean, lb, ub and var as MC::price, the
+    // bounds being the price itself); N_steps is the grid on which the
+    // exercise dates are given (every step of it for american options)
+    map<string, double> price(double S_0, double T, size_t N_steps = 1);
+
+};
+
+#endif // !#ifndef PDE_HPP
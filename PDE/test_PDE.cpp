@@ -0,0 +1,79 @@
+// checks of the finite difference engine against closed forms and reference values
+
+#include "PDE.hpp"
+
+#include <cmath>
+#include <iostream>
+
+static size_t failures = 0;
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        std::cout << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// largest error of the european calls and puts against the closed form on a
+// grid of N_space x N_time
+static double error(BlackScholes& model, size_t N_space, size_t N_time) {
+    double worst = 0.0;
+    for (double K : {80.0, 90.0, 100.0, 110.0, 120.0}) {
+        EU_Call call = EU_Call(K);
+        EU_Put put = EU_Put(K);
+        PDE calls = PDE(&model, &call, N_space, N_time);
+        PDE puts = PDE(&model, &put, N_space, N_time);
+        worst = std::max(worst, std::abs(calls.price(100.0, 1.0)["mean"]
+            - model.european(100.0, K, 1.0, true)));
+        worst = std::max(worst, std::abs(puts.price(100.0, 1.0)["mean"]
+            - model.european(100.0, K, 1.0, false)));
+    }
+    return worst;
+}
+
+// european options: about 2e-4 on 400 x 200, second order convergence
+static void check_european() {
+
+    BlackScholes model = BlackScholes(0.05, 0.2);
+    double coarse = error(model, 400, 200);
+    double fine = error(model, 800, 400);
+    check(coarse <= 2.5e-4, "european error " + std::to_string(coarse) + " on 400 x 200");
+    check(fine <= coarse / 3.5, "second order: error " + std::to_string(fine)
+        + " on 800 x 400");
+}
+
+// american put of Longstaff and Schwartz (2001), table 1: S_0 = 36, K = 40,
+// r = 0.06, sigma = 0.2, T = 1
+static void check_american() {
+
+    BlackScholes model = BlackScholes(0.06, 0.2);
+    AM_Put put = AM_Put(40.0);
+
+    // exercised on 50 dates, the contract of their finite difference value 4.478
+    PDE bermudan = PDE(&model, &put);
+    double price = bermudan.price(36.0, 1.0, 50)["mean"];
+    check(std::abs(price - 4.478) <= 1e-3, "put on 50 dates " + std::to_string(price)
+        + " matches the reference 4.478");
+
+    // exercised on every step of a fine grid, close to the continuous
+    // exercise value 4.4866 (binomial tree)
+    PDE american = PDE(&model, &put, 1000, 1000);
+    price = american.price(36.0, 1.0, 1000)["mean"];
+    check(std::abs(price - 4.4866) <= 1e-3, "put on 1000 dates " + std::to_string(price)
+        + " matches the american reference 4.4866");
+
+    // a single exercise date is the european put
+    price = bermudan.price(36.0, 1.0, 1)["mean"];
+    check(std::abs(price - model.european(36.0, 40.0, 1.0, false)) <= 2e-4,
+        "put on a single date is the european put");
+}
+
+int main() {
+    check_european();
+    check_american();
+    if (failures)
+        std::cout << failures << " check(s) failed" << std::endl;
+    else
+        std::cout << "all checks passed" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,237 @@
+#include "calibration.hpp"
+#include "LSM.hpp"
+#include "MC.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <stdexcept>
+
+using clock_type = std::chrono::steady_clock;
+
+Calibrator::Calibrator(ModelFactory factory, vector<Instrument> instruments, double S_0,
+    size_t N_sim, size_t N_steps, std::mt19937::result_type seed, ThreadPool* pool,
+    size_t block)
+    : m_factory(factory), m_instruments(instruments), m_S_0(S_0), m_N_sim(N_sim),
+      m_N_steps(N_steps), m_block(block), m_seed(seed),
+      m_pool(pool ? *pool : ThreadPool::shared()) {
+
+    if (m_instruments.empty())
+        throw std::invalid_argument("Calibrator: no instruments");
+    if (N_sim == 0 || N_steps == 0 || block == 0)
+        throw std::invalid_argument("Calibrator: N_sim, N_steps and block must be positive");
+
+    // group the instruments by maturity
+    for (size_t i = 0; i < m_instruments.size(); i++) {
+        auto same = [this, i](const vector<size_t>& group) {
+            return m_instruments[group[0]].T == m_instruments[i].T;
+        };
+        auto group = std::find_if(m_groups.begin(), m_groups.end(), same);
+        if (group == m_groups.end())
+            m_groups.push_back({i});
+        else
+            group->push_back(i);
+    }
+}
+
+vector<vector<double>> Calibrator::evaluate(const vector<vector<double>>& params) {
+
+    // build the models (invalid parameters give no model)
+    vector<std::unique_ptr<Model>> models;
+    for (const auto& p : params) {
+        try {
+            models.push_back(m_factory(p));
+        } catch (const std::exception&) {
+            models.push_back(nullptr);
+        }
+    }
+
+    size_t N_blocks = (m_N_sim + m_block - 1) / m_block;
+
+    // payoff sums of every (parameters, maturity, block), merged in block order
+    vector<vector<vector<vector<double>>>> sums(params.size(),
+        vector<vector<vector<double>>>(m_groups.size()));
+    vector<std::future<void>> tasks;
+
+    for (size_t p = 0; p < params.size(); p++) {
+        if (!models[p])
+            continue;
+        for (size_t g = 0; g < m_groups.size(); g++) {
+            sums[p][g].assign(N_blocks, vector<double>(m_groups[g].size(), 0.0));
+            for (size_t b = 0; b < N_blocks; b++) {
+                tasks.push_back(m_pool.submit([this, &models, &sums, p, g, b]() {
+                    // common random numbers: the stream only depends on the
+                    // maturity and the block, never on the parameters
+                    Model::seed(m_seed, {g, b});
+
+                    const vector<size_t>& group = m_groups[g];
+                    const Instrument& first = m_instruments[group[0]];
+                    size_t n = std::min(m_block, m_N_sim - b * m_block);
+
+                    // one set of paths for all the instruments of the maturity
+                    MC mc = MC(models[p].get(), first.option);
+                    Matrix<double> S = mc.simulate(n, m_N_steps, m_S_0, first.T);
+                    for (size_t j = 0; j < group.size(); j++) {
+                        const Instrument& instrument = m_instruments[group[j]];
+                        const PathOption* path_option =
+                            dynamic_cast<const PathOption*>(instrument.option);
+                        Vec<double> payoff = path_option
+                            ? path_option->payoff(S, instrument.DF, instrument.T)
+                            : instrument.option->payoff(S, instrument.DF);
+                        double sum = 0.0;
+                        for (size_t i = 0; i < n; i++)
+                            sum += payoff[i];
+                        sums[p][g][b][j] = sum;
+                    }
+                }));
+            }
+        }
+    }
+    for (auto& task : tasks)
+        task.get();
+
+    vector<vector<double>> prices(params.size(),
+        vector<double>(m_instruments.size(), std::numeric_limits<double>::quiet_NaN()));
+    for (size_t p = 0; p < params.size(); p++) {
+        if (!models[p])
+            continue;
+        for (size_t g = 0; g < m_groups.size(); g++) {
+            for (size_t j = 0; j < m_groups[g].size(); j++) {
+                double sum = 0.0;
+                for (size_t b = 0; b < N_blocks; b++)
+                    sum += sums[p][g][b][j];
+                prices[p][m_groups[g][j]] = sum / m_N_sim;
+            }
+        }
+    }
+    return prices;
+}
+
+vector<double> Calibrator::residuals(const vector<double>& prices) const {
+    vector<double> r(m_instruments.size());
+    for (size_t i = 0; i < r.size(); i++)
+        r[i] = m_instruments[i].weight * (prices[i] - m_instruments[i].price);
+    return r;
+}
+
+vector<double> Calibrator::prices(const vector<double>& params) {
+    return evaluate({params})[0];
+}
+
+vector<double> Calibrator::calibrate(vector<double> params, size_t max_iter, double tol) {
+
+    size_t n = params.size();
+    size_t m = m_instruments.size();
+    auto squared = [](const vector<double>& r) {
+        double sum = 0.0;
+        for (double x : r)
+            sum += x * x;
+        return sum;
+    };
+
+    m_times.clear();
+    vector<double> current = prices(params);
+    vector<double> r = residuals(current);
+    double cost = squared(r);
+    if (!std::isfinite(cost))
+        throw std::invalid_argument("Calibrator::calibrate: invalid initial parameters");
+
+    double mu = 1e-3;
+    for (size_t iter = 0; iter < max_iter; iter++) {
+        clock_type::time_point start = clock_type::now();
+
+        // central differences on the common random numbers, all the bumped
+        // parameters being priced in one parallel batch
+        vector<double> h(n);
+        vector<vector<double>> bumped;
+        for (size_t k = 0; k < n; k++) {
+            h[k] = 1e-4 * std::max(std::abs(params[k]), 1e-2);
+            vector<double> up = params, down = params;
+            up[k] += h[k];
+            down[k] -= h[k];
+            bumped.push_back(up);
+            bumped.push_back(down);
+        }
+        vector<vector<double>> bumped_prices = evaluate(bumped);
+
+        // Jacobian of the residuals (m x n), one sided at the invalid side
+        vector<double> J(m * n);
+        for (size_t k = 0; k < n; k++) {
+            const vector<double>& up = bumped_prices[2*k];
+            const vector<double>& down = bumped_prices[2*k + 1];
+            for (size_t i = 0; i < m; i++) {
+                double w = m_instruments[i].weight;
+                if (std::isfinite(up[i]) && std::isfinite(down[i]))
+                    J[i*n + k] = w * (up[i] - down[i]) / (2.0 * h[k]);
+                else if (std::isfinite(up[i]))
+                    J[i*n + k] = w * (up[i] - current[i]) / h[k];
+                else
+                    J[i*n + k] = w * (current[i] - down[i]) / h[k];
+            }
+        }
+
+        // normal equations J^T J and gradient J^T r
+        vector<double> A(n * n, 0.0), g(n, 0.0);
+        for (size_t i = 0; i < m; i++)
+            for (size_t a = 0; a < n; a++) {
+                g[a] += J[i*n + a] * r[i];
+                for (size_t b = 0; b < n; b++)
+                    A[a*n + b] += J[i*n + a] * J[i*n + b];
+            }
+
+        // damped steps until the cost decreases
+        bool accepted = false;
+        double step = 0.0;
+        for (size_t attempt = 0; attempt < 20 && !accepted; attempt++) {
+            vector<double> A_mu = A, minus_g(n);
+            for (size_t a = 0; a < n; a++) {
+                A_mu[a*n + a] += mu * std::max(A[a*n + a], 1e-12);
+                minus_g[a] = -g[a];
+            }
+            vector<double> delta = solve_spd(A_mu, minus_g);
+
+            vector<double> trial = params;
+            for (size_t a = 0; a < n; a++)
+                trial[a] += delta[a];
+            vector<double> prices_trial = prices(trial);
+            vector<double> r_trial = residuals(prices_trial);
+            double cost_trial = squared(r_trial);
+
+            if (std::isfinite(cost_trial) && cost_trial < cost) {
+                accepted = true;
+                step = 0.0;
+                for (size_t a = 0; a < n; a++)
+                    step = std::max(step, std::abs(delta[a]) / (std::abs(params[a]) + tol));
+                double decrease = (cost - cost_trial) / std::max(cost, tol);
+                params = trial;
+                current = prices_trial;
+                r = r_trial;
+                cost = cost_trial;
+                mu = std::max(mu / 3.0, 1e-12);
+                if (decrease < tol)
+                    step = 0.0;
+            } else {
+                mu *= 4.0;
+            }
+        }
+
+        m_times.push_back(std::chrono::duration<double>(clock_type::now() - start).count());
+
+        // converged (or no descent direction left)
+        if (!accepted || step < sqrt(tol))
+            break;
+    }
+
+    m_rmse = sqrt(cost / m);
+    return params;
+}
+
+const vector<double>& Calibrator::iteration_times() const {
+    return m_times;
+}
+
+double Calibrator::rmse() const {
+    return m_rmse;
+}
@@ -0,0 +1,86 @@
+#ifndef CALIBRATION_HPP
+#define CALIBRATION_HPP
+
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "model.hpp"
+#include "option.hpp"
+#include "pool.hpp"
+#include "vec.hpp"
+
+using std::vector;
+
+// market instrument to fit (the option is not owned)
+struct Instrument {
+    Option* option;
+    // maturity and discount factors of the simulation grid (last one at T)
+    double T;
+    Vec<double> DF;
+    // market price and weight of the residual
+    double price;
+    double weight = 1.0;
+};
+
+// builds the model for a vector of parameters (may throw for invalid ones)
+typedef std::function<std::unique_ptr<Model>(const vector<double>&)> ModelFactory;
+
+// Levenberg-Marquardt calibration of a model to a set of instruments priced by
+// Monte Carlo with common random numbers: each block of paths of each maturity
+// is always simulated from the same stream, and the models draw a fixed number
+// of variates per path and step, so the paths move continuously with the
+// parameters and the finite difference Jacobian (computed on the same draws)
+// is the pathwise derivative of the sample prices; the exceptions are
+// discrete variates such as the jump counts of Merton, which change on a few
+// paths at a time when the intensity moves (the derivative in lambda is then
+// a noisy finite difference, whose noise decreases with N_sim)
+class Calibrator {
+
+private:
+    // model builder and instruments
+    ModelFactory m_factory;
+    vector<Instrument> m_instruments;
+    // instruments grouped by maturity (they share the paths)
+    vector<vector<size_t>> m_groups;
+    // simulation setup
+    double m_S_0;
+    size_t m_N_sim;
+    size_t m_N_steps;
+    size_t m_block;
+    std::mt19937::result_type m_seed;
+    // workers evaluating all the (parameters, maturity, block) tasks (borrowed)
+    ThreadPool& m_pool;
+    // wall time of each iteration of the last calibration (seconds)
+    vector<double> m_times;
+    // root mean square of the weighted residuals at the solution
+    double m_rmse = 0.0;
+
+    // model prices of the instruments for several parameter vectors at once
+    // (NaN prices for parameters rejected by the factory)
+    vector<vector<double>> evaluate(const vector<vector<double>>& params);
+    // weighted residuals (model - market) from model prices
+    vector<double> residuals(const vector<double>& prices) const;
+
+public:
+    // constructor (the tasks run on pool, the shared one by default)
+    Calibrator(ModelFactory factory, vector<Instrument> instruments, double S_0,
+        size_t N_sim, size_t N_steps, std::mt19937::result_type seed = 42,
+        ThreadPool* pool = nullptr, size_t block = 8192);
+
+    // fit the parameters starting from an initial guess
+    vector<double> calibrate(vector<double> params, size_t max_iter = 50,
+        double tol = 1e-10);
+
+    // model prices of the instruments (same draws as the calibration)
+    vector<double> prices(const vector<double>& params);
+
+    // wall time of each iteration of the last calibration (seconds)
+    const vector<double>& iteration_times() const;
+    // root mean square of the weighted residuals at the solution
+    double rmse() const;
+
+};
+
+#endif // !#ifndef CALIBRATION_HPP
@@ -3,9 +3,11 @@
 #include "matrix.hpp"
 #include "vec.hpp"
 #include "MC.hpp"
+#include "server.hpp"
 
 #include <iostream>
 #include <chrono>
+#include <cstdlib>
 
 using BlackScholes = BlackScholes;
 
@@ -17,6 +19,18 @@ double N(double x) {
 
 int main(int argc, char* argv[]){
 
+    // server mode: price the requests read from stdin (or from a Unix socket);
+    // payoff scripts are read from the directory MC_SCRIPT_DIR, if set
+    if (argc > 1 && string(argv[1]) == "--server") {
+        const char* scripts = std::getenv("MC_SCRIPT_DIR");
+        PricingServer server = PricingServer(0, scripts ? scripts : "");
+        if (argc > 2)
+            server.serve_socket(argv[2]);
+        else
+            server.serve(std::cin, std::cout);
+        return 0;
+    }
+
     // start elapsed time
     auto start = std::chrono::high_resolution_clock::now();
 
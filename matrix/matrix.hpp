@@ -31,7 +31,8 @@ public:
     explicit Matrix<T>(size_type rows, size_type cols, container_type values);
 
     // elements access
-    column_type operator [] (size_type);
+    column_type & operator [] (size_type);
+    const column_type & operator [] (size_type) const;
 
     // size access
     size_type rows (void) const;
@@ -63,7 +64,12 @@ Matrix<T>::Matrix(size_type rows, size_type cols, container_type values)
 
 // elements access
 template <class T>
-typename Matrix<T>::column_type Matrix<T>::operator [] (size_type j) {
+typename Matrix<T>::column_type & Matrix<T>::operator [] (size_type j) {
+    return m_data[j];
+}
+
+template <class T>
+const typename Matrix<T>::column_type & Matrix<T>::operator [] (size_type j) const {
     return m_data[j];
 }
 
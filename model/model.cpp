@@ -1,10 +1,25 @@
 #include "model.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 using std::vector;
 
 // initialize the random number generator
 // (seed = 42, the answer to the ultimate question of life, the universe, and everything)
-std::mt19937 Model::m_rng(42);
+thread_local std::mt19937 Model::m_rng(42);
+
+void Model::seed(std::mt19937::result_type s) {
+    m_rng.seed(s);
+}
+
+void Model::seed(std::mt19937::result_type s, std::initializer_list<size_t> keys) {
+    vector<std::mt19937::result_type> values = {s};
+    for (size_t key : keys)
+        values.push_back(static_cast<std::mt19937::result_type>(key));
+    std::seed_seq seq(values.begin(), values.end());
+    m_rng.seed(seq);
+}
 
 // getters
 string Model::name() const {
@@ -24,6 +39,10 @@ double Model::operator [] (string key) const {
     return m_params.at(key);
 }
 
+std::complex<double> Model::cf(double u, double T) const {
+    throw std::logic_error("no characteristic function for the " + m_name + " model");
+}
+
 std::ostream& operator << (std::ostream& os, const Model& model) {
     os << model.name() << " ";
     for (const auto& param : model.params())
@@ -45,12 +64,515 @@ Vec<double> BlackScholes::simulate(const Vec<double>& S_0, double dt) const {
     double sigma = m_params.at("sigma");
     double d = m_params.at("d");
 
-    // simulate the model
+    // simulate the model (one distribution for the whole vector, so that the
+    // normals generated in pairs are not thrown away)
+    normal_distribution<double> dist(0.0, 1.0);
+    double drift = (r - d - 0.5 * sigma * sigma) * dt;
+    double vol = sigma * sqrt(dt);
     Vec<double> S_t(S_0.size());
     for (size_t i = 0; i < S_0.size(); i++) {
         // generate the normal random variable (rescaled)
-        double Z = randn() * sqrt(dt);
-        S_t[i] = S_0[i] * exp((r - d - 0.5 * sigma * sigma) * dt + sigma * Z);
+        double Z = dist(m_rng);
+        S_t[i] = S_0[i] * exp(drift + vol * Z);
+    }
+    return S_t;
+}
+
+Vec<double> BlackScholes::simulate(const Vec<double>& S_0, double dt, double theta,
+    Vec<double>& Z_sum) const {
+
+    // retrieve the parameters
+    double r = m_params.at("r");
+    double sigma = m_params.at("sigma");
+    double d = m_params.at("d");
+
+    // shifted normals Z + theta
+    normal_distribution<double> dist(theta, 1.0);
+    double drift = (r - d - 0.5 * sigma * sigma) * dt;
+    double vol = sigma * sqrt(dt);
+    Vec<double> S_t(S_0.size());
+    for (size_t i = 0; i < S_0.size(); i++) {
+        double Z = dist(m_rng);
+        S_t[i] = S_0[i] * exp(drift + vol * Z);
+        Z_sum[i] += Z;
     }
     return S_t;
 }
+
+double BlackScholes::european(double S_0, double K, double T, bool call) const {
+
+    // retrieve the parameters
+    double r = m_params.at("r");
+    double sigma = m_params.at("sigma");
+    double d = m_params.at("d");
+
+    // standard normal cdf
+    auto N = [](double x) { return 0.5 * erfc(-x * M_SQRT1_2); };
+
+    double F = S_0 * exp((r - d) * T);
+    double DF = exp(-r * T);
+    double s = sigma * sqrt(T);
+    // degenerate volatility or maturity: discounted intrinsic value of the forward
+    if (s <= 0.0)
+        return DF * std::max(call ? F - K : K - F, 0.0);
+
+    double d1 = (log(F / K) + 0.5 * s * s) / s;
+    double d2 = d1 - s;
+    if (call)
+        return DF * (F * N(d1) - K * N(d2));
+    return DF * (K * N(-d2) - F * N(-d1));
+}
+
+std::complex<double> BlackScholes::cf(double u, double T) const {
+
+    // retrieve the parameters
+    double r = m_params.at("r");
+    double sigma = m_params.at("sigma");
+    double d = m_params.at("d");
+
+    const std::complex<double> i(0.0, 1.0);
+    return exp(i * u * (r - d - 0.5 * sigma * sigma) * T - 0.5 * sigma * sigma * u * u * T);
+}
+
+Merton::Merton(double r, double sigma, double lambda, double mu_J, double sigma_J,
+    double d)
+    : Model("Merton", {{"r", r}, {"sigma", sigma}, {"lambda", lambda}, {"mu_J", mu_J},
+        {"sigma_J", sigma_J}, {"d", d}}) {
+    // check if the parameters are valid
+    if (sigma < 0.0 || sigma_J < 0.0)
+        throw std::invalid_argument("sigma and sigma_J must be non-negative");
+    if (lambda < 0.0)
+        throw std::invalid_argument("lambda must be non-negative");
+}
+
+// inverse of the standard normal distribution function on (0, 1): rational
+// approximation of Acklam (relative error 1.2e-9) refined by one Halley step
+static double inverse_normal(double p) {
+    static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02,
+        -2.759285104469687e+02, 1.383577518672690e+02, -3.066479806614716e+01,
+        2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02,
+        -1.556989798598866e+02, 6.680131188771972e+01, -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01,
+        -2.400758277161838e+00, -2.549732539343734e+00, 4.374664141464968e+00,
+        2.938163982698783e+00};
+    static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01,
+        2.445134137142996e+00, 3.754408661907416e+00};
+
+    double x;
+    if (p < 0.02425 || p > 1.0 - 0.02425) {
+        // tails
+        double q = sqrt(-2.0 * log(p < 0.5 ? p : 1.0 - p));
+        x = (((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5])
+            / ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1.0);
+        if (p > 0.5)
+            x = -x;
+    } else {
+        double q = p - 0.5, t = q * q;
+        x = (((((a[0]*t + a[1])*t + a[2])*t + a[3])*t + a[4])*t + a[5]) * q
+            / (((((b[0]*t + b[1])*t + b[2])*t + b[3])*t + b[4])*t + 1.0);
+    }
+    double e = 0.5 * erfc(-x * M_SQRT1_2) - p;
+    double u = e * sqrt(2.0 * M_PI) * exp(0.5 * x * x);
+    return x - u / (1.0 + 0.5 * x * u);
+}
+
+Vec<double> Merton::simulate(const Vec<double>& S_0, double dt) const {
+
+    // retrieve the parameters
+    double r = m_params.at("r");
+    double sigma = m_params.at("sigma");
+    double d = m_params.at("d");
+    double lambda = m_params.at("lambda");
+    double mu_J = m_params.at("mu_J");
+    double sigma_J = m_params.at("sigma_J");
+
+    // compensated drift (the jumps have mean exp(mu_J + sigma_J^2/2) - 1)
+    double kappa = exp(mu_J + 0.5 * sigma_J * sigma_J) - 1.0;
+    double drift = (r - d - lambda * kappa - 0.5 * sigma * sigma) * dt;
+    double vol = sigma * sqrt(dt);
+
+    // cumulative distribution of the number of jumps in a step, truncated where
+    // the remaining mass is negligible (a handful of entries for usual steps)
+    vector<double> cdf;
+    double mean = lambda * dt;
+    double pmf = exp(-mean), total = pmf;
+    cdf.push_back(total);
+    for (size_t k = 1; 1.0 - total > 1e-15 && k < 1000; k++) {
+        pmf *= mean / k;
+        total += pmf;
+        cdf.push_back(total);
+    }
+
+    normal_distribution<double> dist(0.0, 1.0);
+    double U[m_block], Z[m_block], J[m_block];
+    size_t jumps[m_block];
+
+    Vec<double> S_t(S_0.size());
+    for (size_t first = 0; first < S_0.size(); first += m_block) {
+        size_t n = std::min(m_block, S_0.size() - first);
+
+        // diffusion normal and jump uniform of every path: the number of draws
+        // never depends on the parameters, so that common random numbers keep
+        // the paths aligned when the parameters move (the uniform, in (0, 1),
+        // takes 53 bits from two words without the generic loop of
+        // uniform_real_distribution)
+        for (size_t i = 0; i < n; i++) {
+            Z[i] = dist(m_rng);
+            std::mt19937::result_type hi = m_rng() >> 5, lo = m_rng() >> 6;
+            U[i] = (hi * 67108864.0 + lo + 0.5) * 0x1p-53;
+        }
+
+        // paths with at least one jump (a few percent for usual steps)
+        size_t N_jumps = 0;
+        for (size_t i = 0; i < n; i++) {
+            J[i] = 0.0;
+            jumps[N_jumps] = i;
+            N_jumps += U[i] > cdf[0];
+        }
+
+        // total log jump of these paths: the count k by inversion, then the
+        // position of U within the probability of k, a uniform independent of
+        // k, whose normal quantile gives the sum of the k jumps (exactly normal
+        // with mean k mu_J and variance k sigma_J^2)
+        for (size_t j = 0; j < N_jumps; j++) {
+            size_t i = jumps[j];
+            size_t k = 1;
+            while (k < cdf.size() && U[i] > cdf[k])
+                k++;
+            double lower = cdf[k - 1];
+            double upper = k < cdf.size() ? cdf[k] : 1.0;
+            double V = (U[i] - lower) / (upper - lower);
+            V = std::min(std::max(V, 1e-300), 1.0 - 1e-16);
+            J[i] = k * mu_J + sqrt(double(k)) * sigma_J * inverse_normal(V);
+        }
+
+        for (size_t i = 0; i < n; i++)
+            S_t[first + i] = S_0[first + i] * exp(drift + vol * Z[i] + J[i]);
+    }
+    return S_t;
+}
+
+double Merton::european(double S_0, double K, double T, bool call) const {
+
+    // retrieve the parameters
+    double r = m_params.at("r");
+    double sigma = m_params.at("sigma");
+    double d = m_params.at("d");
+    double lambda = m_params.at("lambda");
+    double mu_J = m_params.at("mu_J");
+    double sigma_J = m_params.at("sigma_J");
+
+    double kappa = exp(mu_J + 0.5 * sigma_J * sigma_J) - 1.0;
+    // intensity under the jump-adjusted measure
+    double lambda_J = lambda * (1.0 + kappa) * T;
+
+    // sum of Black-Scholes prices conditional on n jumps, weighted by the
+    // Poisson probabilities (stops when the weights are negligible)
+    double price = 0.0;
+    double weight = exp(-lambda_J);
+    for (size_t n = 0; n < 1000; n++) {
+        if (n > 0)
+            weight *= lambda_J / n;
+        double r_n = r - lambda * kappa + n * log(1.0 + kappa) / T;
+        double sigma_n = sqrt(sigma * sigma + n * sigma_J * sigma_J / T);
+        // (the weights at the adjusted intensity absorb the discounting at r_n)
+        BlackScholes model = BlackScholes(r_n, sigma_n, d);
+        price += weight * model.european(S_0, K, T, call);
+        if (n > lambda_J && weight < 1e-16)
+            break;
+    }
+    return price;
+}
+
+std::complex<double> Merton::cf(double u, double T) const {
+
+    // retrieve the parameters
+    double r = m_params.at("r");
+    double sigma = m_params.at("sigma");
+    double d = m_params.at("d");
+    double lambda = m_params.at("lambda");
+    double mu_J = m_params.at("mu_J");
+    double sigma_J = m_params.at("sigma_J");
+
+    const std::complex<double> i(0.0, 1.0);
+    double kappa = exp(mu_J + 0.5 * sigma_J * sigma_J) - 1.0;
+    // diffusion part (compensated) times the compound Poisson part
+    std::complex<double> jumps = exp(i * u * mu_J - 0.5 * sigma_J * sigma_J * u * u) - 1.0;
+    return exp(i * u * (r - d - lambda * kappa - 0.5 * sigma * sigma) * T
+        - 0.5 * sigma * sigma * u * u * T + lambda * T * jumps);
+}
+
+Heston::Heston(double r, double kappa, double theta, double xi, double rho, double v0,
+    double d)
+    : Model("Heston", {{"r", r}, {"kappa", kappa}, {"theta", theta}, {"xi", xi},
+        {"rho", rho}, {"v0", v0}, {"d", d}}) {
+    // check if the parameters are valid
+    if (kappa <= 0.0)
+        throw std::invalid_argument("kappa must be positive");
+    if (theta < 0.0 || v0 < 0.0)
+        throw std::invalid_argument("theta and v0 must be non-negative");
+    if (xi <= 0.0)
+        throw std::invalid_argument("xi must be positive");
+    if (rho < -1.0 || rho > 1.0)
+        throw std::invalid_argument("rho must be in [-1, 1]");
+}
+
+Vec<double> Heston::simulate(const Vec<double>& S, double dt) const {
+    throw std::logic_error("Heston::simulate: the variance is part of the state, use step");
+}
+
+State Heston::init(size_t N, double S_0) const {
+    return {Vec<double>(N, S_0), Vec<double>(N, m_params.at("v0"))};
+}
+
+void Heston::step(State& X, double t, double dt) const {
+
+    // retrieve the parameters
+    double r = m_params.at("r");
+    double d = m_params.at("d");
+    double kappa = m_params.at("kappa");
+    double theta = m_params.at("theta");
+    double xi = m_params.at("xi");
+    double rho = m_params.at("rho");
+
+    // constants of the step
+    const double psi_c = 1.5;
+    double E = exp(-kappa * dt);
+    double c1 = xi * xi * E * (1.0 - E) / kappa;
+    double c2 = theta * xi * xi * (1.0 - E) * (1.0 - E) / (2.0 * kappa);
+    // log-spot discretization (central, gamma_1 = gamma_2 = 1/2)
+    double K0 = -rho * kappa * theta * dt / xi;
+    double K1 = 0.5 * dt * (kappa * rho / xi - 0.5) - rho / xi;
+    double K2 = 0.5 * dt * (kappa * rho / xi - 0.5) + rho / xi;
+    double K3 = 0.5 * dt * (1.0 - rho * rho);
+    double K4 = K3;
+    double A = K2 + 0.5 * K4;
+    double drift = (r - d) * dt;
+
+    double* S = &X[0][0];
+    double* v = &X[1][0];
+    size_t N = X[0].size();
+
+    // normals of the block (drawn first, so that the kernel has no calls into the generator)
+    normal_distribution<double> dist(0.0, 1.0);
+    double Z_v[m_block], Z_S[m_block];
+
+    for (size_t first = 0; first < N; first += m_block) {
+        size_t n = std::min(m_block, N - first);
+        for (size_t i = 0; i < n; i++) {
+            Z_v[i] = dist(m_rng);
+            Z_S[i] = dist(m_rng);
+        }
+
+        // both regimes are computed for every path and the result is selected,
+        // a branch per path would defeat vectorization
+        double* S_b = S + first;
+        double* v_b = v + first;
+        for (size_t i = 0; i < n; i++) {
+            double v_t = v_b[i];
+            // conditional moments of the variance
+            double m = std::max(theta + (v_t - theta) * E, 1e-300);
+            double s2 = v_t * c1 + c2;
+            double psi = s2 / (m * m);
+            bool quadratic = psi <= psi_c;
+
+            // quadratic regime: v = a (b + Z)^2
+            double inv_q = 1.0 / std::min(psi, psi_c);
+            double b2 = 2.0 * inv_q - 1.0 + sqrt(2.0 * inv_q) * sqrt(2.0 * inv_q - 1.0);
+            double a = m / (1.0 + b2);
+            double v_q = a * (sqrt(b2) + Z_v[i]) * (sqrt(b2) + Z_v[i]);
+
+            // exponential regime: mass p at zero, exponential tail of rate beta
+            double psi_e = std::max(psi, psi_c);
+            double p = (psi_e - 1.0) / (psi_e + 1.0);
+            double beta = (1.0 - p) / m;
+            double U = 0.5 * erfc(-Z_v[i] * M_SQRT1_2);
+            double v_e = log(std::max((1.0 - p) / (1.0 - U), 1.0)) / beta;
+
+            double v_next = quadratic ? v_q : v_e;
+
+            // martingale correction of the drift (falls back to the plain
+            // drift where the moment generating function does not exist)
+            double q = 1.0 - 2.0 * A * a;
+            double K0_q = -A * b2 * a / q + 0.5 * log(std::max(q, 1e-300));
+            double K0_e = -log(p + beta * (1.0 - p) / (beta - A));
+            bool valid = quadratic ? q > 0.0 : beta > A;
+            double K0_star = valid ? (quadratic ? K0_q : K0_e) - (K1 + 0.5 * K3) * v_t : K0;
+
+            S_b[i] *= exp(drift + K0_star + K1 * v_t + K2 * v_next
+                + sqrt(K3 * v_t + K4 * v_next) * Z_S[i]);
+            v_b[i] = v_next;
+        }
+    }
+}
+
+std::complex<double> Heston::cf(double u, double T) const {
+
+    // retrieve the parameters
+    double r = m_params.at("r");
+    double d = m_params.at("d");
+    double kappa = m_params.at("kappa");
+    double theta = m_params.at("theta");
+    double xi = m_params.at("xi");
+    double rho = m_params.at("rho");
+    double v0 = m_params.at("v0");
+
+    const std::complex<double> i(0.0, 1.0);
+    std::complex<double> beta = kappa - rho * xi * i * u;
+    std::complex<double> D = sqrt(beta * beta + xi * xi * (i * u + u * u));
+    std::complex<double> g = (beta - D) / (beta + D);
+    std::complex<double> E = exp(-D * T);
+
+    std::complex<double> C = i * u * (r - d) * T + kappa * theta / (xi * xi)
+        * ((beta - D) * T - 2.0 * log((1.0 - g * E) / (1.0 - g)));
+    std::complex<double> B = (beta - D) / (xi * xi) * (1.0 - E) / (1.0 - g * E);
+    return exp(C + B * v0);
+}
+
+LocalVol::LocalVol(double r, Surface sigma, double S_min, double S_max, size_t N_x,
+    double d)
+    : Model("Local Volatility", {{"r", r}, {"d", d}, {"S_min", S_min}, {"S_max", S_max},
+        {"N_x", double(N_x)}}), m_sigma(sigma), m_N_x(N_x) {
+    // check if the parameters are valid
+    if (!sigma)
+        throw std::invalid_argument("the local volatility surface is empty");
+    if (S_min <= 0.0 || S_max <= S_min)
+        throw std::invalid_argument("the spot grid must satisfy 0 < S_min < S_max");
+    if (N_x < 2)
+        throw std::invalid_argument("the spot grid needs at least 2 points");
+
+    m_x_min = log(S_min);
+    m_h = (log(S_max) - m_x_min) / (N_x - 1);
+}
+
+LocalVol::Surface LocalVol::dupire(std::function<double(double, double)> implied,
+    double S_0, double r, double d) {
+
+    // total implied variance w(y, T) in log-moneyness y = ln(K/F)
+    auto w = [=](double y, double T) {
+        double sigma = implied(T, S_0 * exp((r - d) * T + y));
+        return sigma * sigma * T;
+    };
+
+    return [=](double t, double S) {
+        // the surface at t = 0 is the short maturity limit
+        double T = std::max(t, 1e-4);
+        double y = log(S / S_0) - (r - d) * T;
+        const double h_y = 1e-3, h_T = 1e-4;
+
+        double w_0 = w(y, T);
+        double w_T = (w(y, T + h_T) - w(y, T - std::min(h_T, 0.5 * T))) / (h_T + std::min(h_T, 0.5 * T));
+        double w_up = w(y + h_y, T), w_down = w(y - h_y, T);
+        double w_y = (w_up - w_down) / (2.0 * h_y);
+        double w_yy = (w_up - 2.0 * w_0 + w_down) / (h_y * h_y);
+
+        double denom = 1.0 - y / w_0 * w_y
+            + 0.25 * (-0.25 - 1.0 / w_0 + y * y / (w_0 * w_0)) * w_y * w_y + 0.5 * w_yy;
+        // arbitrage in the implied surface shows up as a negative local variance
+        return sqrt(std::max(w_T / denom, 0.0));
+    };
+}
+
+Vec<double> LocalVol::simulate(const Vec<double>& S, double dt) const {
+    throw std::logic_error("LocalVol::simulate: the surface depends on time, use step");
+}
+
+State LocalVol::init(size_t N, double S_0) const {
+    return {Vec<double>(N, S_0), Vec<double>(N, log(S_0))};
+}
+
+void LocalVol::sample(double t, vector<double>& slice) const {
+    // with a copy of the last point, so that the interpolation at the upper end
+    // reads inside the slice
+    slice.resize(m_N_x + 1);
+    for (size_t j = 0; j < m_N_x; j++)
+        slice[j] = m_sigma(t, exp(m_x_min + j * m_h));
+    slice[m_N_x] = slice[m_N_x - 1];
+}
+
+void LocalVol::prepare(double T, size_t N_steps) const {
+
+    if (!(T > 0.0) || N_steps == 0)
+        return;
+    // the times of the engines are i * dt
+    double dt = T / N_steps;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const Grids* current = m_grids.load(std::memory_order_relaxed);
+    Grids grids = current ? *current : Grids();
+    auto same = [dt](const std::shared_ptr<const Slices>& g) { return g->dt == dt; };
+    auto it = std::find_if(grids.begin(), grids.end(), same);
+    if (it != grids.end() && (*it)->at.size() >= N_steps)
+        return;
+
+    // extend the slices of this length of step (or start them)
+    auto slices = std::make_shared<Slices>();
+    slices->dt = dt;
+    if (it != grids.end())
+        slices->at = (*it)->at;
+    for (size_t i = slices->at.size(); i < N_steps; i++) {
+        slices->at.emplace_back();
+        sample(i * dt, slices->at.back());
+    }
+    if (it != grids.end())
+        *it = slices;
+    else
+        grids.push_back(slices);
+
+    m_versions.push_back(std::make_unique<const Grids>(std::move(grids)));
+    m_grids.store(m_versions.back().get(), std::memory_order_release);
+}
+
+void LocalVol::step(State& X, double t, double dt) const {
+
+    // retrieve the parameters
+    double r = m_params.at("r");
+    double d = m_params.at("d");
+
+    // slice of the surface at the start of the step, from the prepared grids
+    // (sampled for this step only on a grid that was not prepared)
+    const double* sigma = nullptr;
+    size_t i = size_t(t / dt + 0.5);
+    if (const Grids* grids = m_grids.load(std::memory_order_acquire))
+        for (const auto& g : *grids)
+            if (g->dt == dt && i < g->at.size() && i * dt == t)
+                sigma = g->at[i].data();
+    vector<double> scratch;
+    if (!sigma) {
+        sample(t, scratch);
+        sigma = scratch.data();
+    }
+    double inv_h = 1.0 / m_h;
+    double u_max = double(m_N_x - 1);
+    double drift = (r - d) * dt;
+    double sqrt_dt = sqrt(dt);
+
+    double* S = &X[0][0];
+    double* x = &X[1][0];
+    size_t N = X[0].size();
+
+    // normals of the block (drawn first, so that the kernel has no calls into the generator)
+    normal_distribution<double> dist(0.0, 1.0);
+    double Z[m_block];
+
+    for (size_t first = 0; first < N; first += m_block) {
+        size_t n = std::min(m_block, N - first);
+        for (size_t i = 0; i < n; i++)
+            Z[i] = dist(m_rng);
+
+        // gather and linear interpolation in log-spot, clamped to the grid
+        // (flat extrapolation) without branches
+        double* S_b = S + first;
+        double* x_b = x + first;
+        for (size_t i = 0; i < n; i++) {
+            double u = std::min(std::max((x_b[i] - m_x_min) * inv_h, 0.0), u_max);
+            size_t j = size_t(u);
+            double w = u - double(j);
+            double vol = sigma[j] + w * (sigma[j + 1] - sigma[j]);
+
+            x_b[i] += drift - 0.5 * vol * vol * dt + vol * sqrt_dt * Z[i];
+            S_b[i] = exp(x_b[i]);
+        }
+    }
+}
@@ -1,8 +1,14 @@
 #ifndef MODEL_HPP
 #define MODEL_HPP
 
+#include <atomic>
+#include <complex>
+#include <memory>
+#include <functional>
+#include <initializer_list>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <random>
 #include <string>
 
@@ -13,13 +19,17 @@ using std::ostream;
 using std::normal_distribution;
 
 #include "vec.hpp"
+
+// state of a set of paths: one vector per factor, the spot being the first
+typedef vector<Vec<double>> State;
    
 // model class used to model the underlying stock dynamics
 class Model {
 
 protected:
-    // random number generator (static member variable)
-    static std::mt19937 m_rng;
+    // random number generator (one stream per thread, so that models can be
+    // simulated concurrently from a thread pool)
+    static thread_local std::mt19937 m_rng;
     // name of the model
     string m_name;
     // parameters of the model {name, value}
@@ -31,6 +41,27 @@ public:
     // pure virtual function to simulate
     virtual Vec<double> simulate(const Vec<double>& S, double dt) const = 0;
 
+    // number of factors of the state (the spot plus e.g. the variance)
+    virtual size_t factors() const { return 1; }
+    // initial state of N paths starting from S_0
+    virtual State init(size_t N, double S_0) const { return {Vec<double>(N, S_0)}; }
+    // advance the state of the paths from t to t + dt (single factor models
+    // only need to implement simulate)
+    virtual void step(State& X, double t, double dt) const { X[0] = simulate(X[0], dt); }
+    // called by the engines before stepping on the grid t_i = i T/N_steps, for
+    // the models that precompute data per time of the grid
+    virtual void prepare(double T, size_t N_steps) const {}
+
+    // characteristic function of the log return ln(S_T/S_0) (for the Fourier
+    // pricers; throws for models without a closed form)
+    virtual std::complex<double> cf(double u, double T) const;
+
+    // reseed the random number generator of the calling thread
+    static void seed(std::mt19937::result_type s);
+    // reseed it with the stream derived from s and keys (e.g. the indices of a
+    // block of paths), so that the draws of a block do not depend on the thread
+    static void seed(std::mt19937::result_type s, std::initializer_list<size_t> keys);
+
     // getters
     string name() const;
 
@@ -50,12 +81,131 @@ public:
     // simulate the model with Black Scholes dynamics (vectorized)
     Vec<double> simulate(const Vec<double>& S, double dt) const override;
 
+    // simulate under a measure where the normals have mean theta (importance
+    // sampling), adding the normals drawn to Z_sum (the likelihood ratio of the
+    // path is exp(theta (N theta / 2 - Z_sum)) after N steps)
+    Vec<double> simulate(const Vec<double>& S, double dt, double theta,
+        Vec<double>& Z_sum) const;
+
+    // closed form price of a European call (or put)
+    double european(double S_0, double K, double T, bool call = true) const;
+
+    // characteristic function of the log return
+    std::complex<double> cf(double u, double T) const override;
+
+};
+
+// Merton jump-diffusion model: Black-Scholes dynamics plus compound Poisson
+// jumps with normally distributed log sizes
+class Merton : public Model {
+
+private:
+    // number of paths processed together by the kernels
+    static constexpr size_t m_block = 1024;
+
+public:
+    // constructor
+    Merton(double r, double sigma, double lambda, double mu_J, double sigma_J,
+        double d=0.0);
+
+    // simulate the model from two variates per path and step: a normal for the
+    // diffusion and a uniform that gives the jump count by inversion, the
+    // leftover of the uniform within its count giving the total jump (exactly
+    // normal given the count)
+    Vec<double> simulate(const Vec<double>& S, double dt) const override;
+
+    // closed form price of a European call (or put), as a series of
+    // Black-Scholes prices conditional on the number of jumps
+    double european(double S_0, double K, double T, bool call = true) const;
+
+    // characteristic function of the log return
+    std::complex<double> cf(double u, double T) const override;
+
+};
+
+// Heston stochastic volatility model, simulated with the quadratic-exponential
+// scheme of Andersen (2008) with martingale correction
+class Heston : public Model {
+
+private:
+    // number of paths processed together by the kernels
+    static constexpr size_t m_block = 1024;
+
+public:
+    // constructor
+    Heston(double r, double kappa, double theta, double xi, double rho, double v0,
+        double d=0.0);
+
+    // the spot alone does not carry the variance, use step
+    Vec<double> simulate(const Vec<double>& S, double dt) const override;
+
+    // state: spot and variance
+    size_t factors() const override { return 2; }
+    State init(size_t N, double S_0) const override;
+    void step(State& X, double t, double dt) const override;
+
+    // characteristic function of the log return (Albrecher et al. form, which
+    // avoids the branch cut of the complex logarithm)
+    std::complex<double> cf(double u, double T) const override;
+
+};
+
+// Dupire local volatility model: dS = (r - d) S dt + sigma(t, S) S dW
+class LocalVol : public Model {
+
+public:
+    // local volatility surface sigma(t, S)
+    typedef std::function<double(double, double)> Surface;
+
 private:
-    // generate a random number from a normal distribution
-    double randn() const {
-        normal_distribution<double> dist(0.0, 1.0);
-        return dist(m_rng);
-    }
+    // number of paths processed together by the kernels
+    static constexpr size_t m_block = 1024;
+
+    // local volatility surface
+    Surface m_sigma;
+    // uniform log-spot grid (the surface is flat outside of it)
+    double m_x_min;
+    double m_h;
+    size_t m_N_x;
+
+    // surface on the spot grid at the times i dt of a simulation grid (one
+    // entry per length of the steps, extended to the longest grid prepared)
+    struct Slices {
+        double dt;
+        vector<vector<double>> at;
+    };
+    typedef vector<std::shared_ptr<const Slices>> Grids;
+
+    // grids read by step without locking: prepare publishes a new version of
+    // the list, the older versions are kept since steps running concurrently
+    // may still read them
+    mutable std::mutex m_mutex;
+    mutable std::atomic<const Grids*> m_grids{nullptr};
+    mutable vector<std::unique_ptr<const Grids>> m_versions;
+
+    // sample the surface at time t on the spot grid
+    void sample(double t, vector<double>& slice) const;
+
+public:
+    // constructor (the surface is sampled on N_x spots log-uniform in [S_min, S_max])
+    LocalVol(double r, Surface sigma, double S_min, double S_max, size_t N_x = 512,
+        double d = 0.0);
+
+    // local volatility from an implied volatility surface implied(T, K) by the
+    // Dupire formula in total variance (finite differences)
+    static Surface dupire(std::function<double(double, double)> implied, double S_0,
+        double r, double d = 0.0);
+
+    // the surface depends on time, use step
+    Vec<double> simulate(const Vec<double>& S, double dt) const override;
+
+    // state: spot and log-spot (the log-Euler scheme works on the latter)
+    size_t factors() const override { return 2; }
+    State init(size_t N, double S_0) const override;
+    void step(State& X, double t, double dt) const override;
+    // build the slices of the grid (steps on grids that were not prepared
+    // sample the surface at every call)
+    void prepare(double T, size_t N_steps) const override;
 
 };
 
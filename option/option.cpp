@@ -1,5 +1,11 @@
 #include "option.hpp"
 
+#include <algorithm>
+
+double Option::operator [] (string key) const {
+    return m_params.at(key);
+}
+
 Vec<double> EU_Call::payoff(Matrix<double> S, Vec<double> DF) const {
     double K = m_params.at("K");
     // get only the last column of S
@@ -19,14 +25,90 @@ Vec<double> EU_Put::payoff(Matrix<double> S, Vec<double> DF) const {
     return S_T ^ 0.0;
 }
 
-Vec<double> ClOption::payoff(Matrix<double> S, Vec<double> DF) const {
+Vec<double> PathOption::payoff(Matrix<double> S, Vec<double> DF) const {
+    // the paths do not carry their time grid, use steps of unit length (only
+    // right for payoffs that ignore the time)
+    if (reads_time())
+        throw std::logic_error("the payoff depends on the time grid, give the maturity");
+    return payoff(S, DF, double(S.columns() - 1));
+}
+
+Vec<double> PathOption::payoff(const Matrix<double>& S, const Vec<double>& DF, double T) const {
+
+    size_t N_sim = S.rows();
+    size_t N_steps = S.columns() - 1;
+    size_t K = state_size();
 
-    double L = m_params.at("L");
-    Vec<double> payoff(S.columns(), 0.0);
+    // discount factors are aligned on maturity (the last one)
+    if (DF.size() < N_steps)
+        throw std::invalid_argument("Not enough discount factors");
+    size_t offset = DF.size() - N_steps;
 
-    for (size_t i = 1; i < S.columns(); i++) {
-        payoff += DF[i] * (L*(S[i] - S[i-1]) ^ 0.0);
+    // run the kernels over the columns
+    double dt = T/N_steps;
+    vector<double> state(N_sim * K);
+    init_block(state.data(), &S[0][0], N_sim);
+    for (size_t i = 1; i <= N_steps; i++) {
+        Step t = {i, i * dt, dt, DF[offset + i - 1]};
+        update_block(state.data(), &S[i-1][0], &S[i][0], N_sim, t);
     }
 
+    Vec<double> payoff(N_sim);
+    value_block(state.data(), &S[N_steps][0], N_sim, DF[DF.size()-1], &payoff[0]);
     return payoff;
 }
+
+Barrier::Barrier(Type type, bool call, double K, double B, double sigma, double monitoring)
+    : StreamingOption({{"K", K}, {"B", B}, {"sigma", sigma}, {"monitoring", monitoring}}),
+      m_type(type), m_phi(call ? 1.0 : -1.0), m_K(K), m_B(B), m_sigma(sigma) {
+    // check the parameters
+    if (K < 0.0)
+        throw std::invalid_argument("K must be non-negative");
+    if (B <= 0.0)
+        throw std::invalid_argument("B must be positive");
+    if (sigma <= 0.0)
+        throw std::invalid_argument("sigma must be positive");
+    if (monitoring < 0.0)
+        throw std::invalid_argument("monitoring must be non-negative");
+
+    // continuity correction: a discretely monitored barrier is priced as a
+    // continuous one moved away from the spot
+    bool up = type == UpOut || type == UpIn;
+    m_B *= exp((up ? 1.0 : -1.0) * 0.5826 * sigma * sqrt(monitoring));
+}
+
+vector<size_t> EarlyExercise::exercise_dates(size_t N_steps) const {
+
+    vector<size_t> dates;
+    if (m_dates.empty()) {
+        // american: every step of the grid (no exercise at inception)
+        for (size_t i = 1; i <= N_steps; i++)
+            dates.push_back(i);
+        return dates;
+    }
+
+    for (size_t i : m_dates) {
+        if (i > N_steps)
+            throw std::invalid_argument("exercise date beyond the simulation grid");
+        if (i > 0)
+            dates.push_back(i);
+    }
+    dates.push_back(N_steps);
+    std::sort(dates.begin(), dates.end());
+    dates.erase(std::unique(dates.begin(), dates.end()), dates.end());
+    return dates;
+}
+
+Vec<double> EarlyExercise::payoff(Matrix<double> S, Vec<double> DF) const {
+    throw std::logic_error("early exercise options must be priced with LSM");
+}
+
+Vec<double> AM_Put::intrinsic(const Vec<double>& S) const {
+    double K = m_params.at("K");
+    return (K - S) ^ 0.0;
+}
+
+Vec<double> AM_Call::intrinsic(const Vec<double>& S) const {
+    double K = m_params.at("K");
+    return (S - K) ^ 0.0;
+}
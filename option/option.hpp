@@ -1,6 +1,8 @@
 #ifndef OPTION_HPP
 #define OPTION_HPP
 
+#include <algorithm>
+#include <cmath>
 #include <map>
 #include <string>
 #include <vector>
@@ -24,6 +26,9 @@ public:
     Option(map<string, double> params) : m_params(params) {}
     // pure virtual function to compute the payoff of an option
     virtual Vec<double> payoff(Matrix<double> S, Vec<double> DF) const = 0; // vector
+
+    // getters
+    double operator [] (string key) const;
 };
 
 class EU_Call : public Option {
@@ -52,18 +57,261 @@ public:
     Vec<double> payoff(Matrix<double> S, Vec<double> DF) const override;
 };
 
-// cliquet option payoff
-class ClOption : public Option {
+// step of the simulation grid, as seen by the streaming payoffs
+struct Step {
+    // index of the step (S_next is the spot at t_i)
+    size_t i;
+    // time of S_next and length of the step
+    double t;
+    double dt;
+    // discount factor of t
+    double DF;
+};
+
+// option whose payoff is a functional of the path that can be accumulated step
+// by step from a small state per path, so that the engine never needs to store
+// the whole path matrix
+class PathOption : public Option {
+
+public:
+    PathOption(map<string, double> params) : Option(params) {}
+    // number of doubles of state per path
+    virtual size_t state_size() const = 0;
+    // initialize the state of n paths (n x state_size doubles, row major unless
+    // the option lays out its blocks otherwise)
+    virtual void init_block(double* state, const double* S_0, size_t n) const = 0;
+    // update the state of n paths over a step
+    virtual void update_block(double* state, const double* S_prev, const double* S_next,
+        size_t n, const Step& t) const = 0;
+    // discounted payoff of n paths from their final state
+    virtual void value_block(const double* state, const double* S_T, size_t n,
+        double DF_T, double* payoff) const = 0;
+    // true if the kernels read the time of the steps (t or dt), which the stored
+    // paths alone do not give
+    virtual bool reads_time() const { return false; }
+    // payoff on stored paths on a grid of maturity T (runs the kernels over the columns)
+    Vec<double> payoff(const Matrix<double>& S, const Vec<double>& DF, double T) const;
+    // payoff on stored paths (the grid is unknown, steps are of unit length;
+    // throws if the kernels read the time of the steps)
+    Vec<double> payoff(Matrix<double> S, Vec<double> DF) const override;
+};
+
+// streaming option implemented by per-path kernels of the derived class
+// (CRTP, so that the kernels are inlined in the block loops):
+//   void init(double* state, double S_0) const
+//   void update(double* state, double S_prev, double S_next, const Step& t) const
+//   double value(const double* state, double S_T, double DF_T) const
+template <class Derived, size_t K>
+class StreamingOption : public PathOption {
+
+public:
+    StreamingOption(map<string, double> params) : PathOption(params) {}
+
+    size_t state_size() const override { return K; }
+
+    void init_block(double* state, const double* S_0, size_t n) const override {
+        const Derived& self = static_cast<const Derived&>(*this);
+        for (size_t i = 0; i < n; i++)
+            self.init(state + i*K, S_0[i]);
+    }
+
+    void update_block(double* state, const double* S_prev, const double* S_next,
+        size_t n, const Step& t) const override {
+        const Derived& self = static_cast<const Derived&>(*this);
+        for (size_t i = 0; i < n; i++)
+            self.update(state + i*K, S_prev[i], S_next[i], t);
+    }
+
+    void value_block(const double* state, const double* S_T, size_t n, double DF_T,
+        double* payoff) const override {
+        const Derived& self = static_cast<const Derived&>(*this);
+        for (size_t i = 0; i < n; i++)
+            payoff[i] = self.value(state + i*K, S_T[i], DF_T);
+    }
+};
+
+// cliquet option payoff (sum of the discounted positive increments)
+class ClOption : public StreamingOption<ClOption, 1> {
+
+private:
+    double m_L;
 
 public:
     // constructor
-    ClOption(double L) : Option({{"L", L}}) {
+    ClOption(double L) : StreamingOption({{"L", L}}), m_L(L) {
         // check that L is positive
         if (L < 0.0)
             throw std::invalid_argument("L must be non-negative");
     }
-    // compute the payoff of a cliquet option (only vector of values)
+    // per path kernels
+    void init(double* state, double S_0) const { state[0] = 0.0; }
+    void update(double* state, double S_prev, double S_next, const Step& t) const {
+        state[0] += t.DF * std::max(m_L * (S_next - S_prev), 0.0);
+    }
+    double value(const double* state, double S_T, double DF_T) const { return state[0]; }
+};
+
+// arithmetic average (fixings on every step after inception) call
+class AS_Call : public StreamingOption<AS_Call, 2> {
+
+private:
+    double m_K;
+
+public:
+    // constructor
+    AS_Call(double K) : StreamingOption({{"K", K}}), m_K(K) {
+        // check that K is positive
+        if (K < 0.0)
+            throw std::invalid_argument("K must be non-negative");
+    }
+    // per path kernels (state: sum and number of fixings)
+    void init(double* state, double S_0) const { state[0] = 0.0; state[1] = 0.0; }
+    void update(double* state, double S_prev, double S_next, const Step& t) const {
+        state[0] += S_next;
+        state[1] += 1.0;
+    }
+    double value(const double* state, double S_T, double DF_T) const {
+        return DF_T * std::max(state[0] / state[1] - m_K, 0.0);
+    }
+};
+
+// floating strike lookback call (S_T minus the minimum of the path)
+class LB_Call : public StreamingOption<LB_Call, 1> {
+
+public:
+    // constructor
+    LB_Call() : StreamingOption({}) {}
+    // per path kernels (state: running minimum)
+    void init(double* state, double S_0) const { state[0] = S_0; }
+    void update(double* state, double S_prev, double S_next, const Step& t) const {
+        state[0] = std::min(state[0], S_next);
+    }
+    double value(const double* state, double S_T, double DF_T) const {
+        return DF_T * (S_T - state[0]);
+    }
+};
+
+// up-and-out call monitored on the simulation grid
+class UO_Call : public StreamingOption<UO_Call, 1> {
+
+private:
+    double m_K;
+    double m_B;
+
+public:
+    // constructor
+    UO_Call(double K, double B) : StreamingOption({{"K", K}, {"B", B}}), m_K(K), m_B(B) {
+        // check that K and B are positive
+        if (K < 0.0 || B < 0.0)
+            throw std::invalid_argument("K and B must be non-negative");
+    }
+    // per path kernels (state: 1 while the barrier has not been hit, 0 after)
+    void init(double* state, double S_0) const { state[0] = S_0 < m_B ? 1.0 : 0.0; }
+    void update(double* state, double S_prev, double S_next, const Step& t) const {
+        state[0] *= S_next < m_B ? 1.0 : 0.0;
+    }
+    double value(const double* state, double S_T, double DF_T) const {
+        return DF_T * state[0] * std::max(S_T - m_K, 0.0);
+    }
+};
+
+// barrier option (call or put) with Brownian bridge monitoring: between two
+// simulated points the probability that the path crossed the barrier is known
+// in closed form, so coarse grids carry no discretization bias; contracts
+// monitored on a discrete schedule use the Broadie-Glasserman-Kou continuity
+// correction (barrier shifted away by 0.5826 sigma sqrt(monitoring step))
+class Barrier : public StreamingOption<Barrier, 1> {
+
+public:
+    enum Type { UpOut, UpIn, DownOut, DownIn };
+
+private:
+    Type m_type;
+    // +1 for a call, -1 for a put
+    double m_phi;
+    double m_K;
+    // barrier used by the bridge (after the continuity correction)
+    double m_B;
+    // volatility used by the bridge
+    double m_sigma;
+
+public:
+    // constructor (monitoring is the step of the contract schedule, 0 = continuous)
+    Barrier(Type type, bool call, double K, double B, double sigma, double monitoring = 0.0);
+
+    // the crossing probability of a step depends on its length
+    bool reads_time() const override { return true; }
+
+    // per path kernels (state: probability that the barrier has not been crossed)
+    void init(double* state, double S_0) const {
+        bool up = m_type == UpOut || m_type == UpIn;
+        state[0] = (up ? S_0 < m_B : S_0 > m_B) ? 1.0 : 0.0;
+    }
+    void update(double* state, double S_prev, double S_next, const Step& t) const {
+        // log distances to the barrier (non-positive once the barrier is crossed,
+        // which gives a crossing probability of one without branching)
+        bool up = m_type == UpOut || m_type == UpIn;
+        double a = up ? log(m_B / S_prev) : log(S_prev / m_B);
+        double b = up ? log(m_B / S_next) : log(S_next / m_B);
+        double crossed = exp(-2.0 * std::max(a, 0.0) * std::max(b, 0.0)
+            / (m_sigma * m_sigma * t.dt));
+        state[0] *= 1.0 - crossed;
+    }
+    double value(const double* state, double S_T, double DF_T) const {
+        bool out = m_type == UpOut || m_type == DownOut;
+        double survival = out ? state[0] : 1.0 - state[0];
+        return DF_T * survival * std::max(m_phi * (S_T - m_K), 0.0);
+    }
+};
+
+// option with early exercise (priced by LSM, not by MC::price)
+class EarlyExercise : public Option {
+
+protected:
+    // indices of the exercise dates on the simulation grid (empty = every step)
+    vector<size_t> m_dates;
+
+public:
+    // constructor
+    EarlyExercise(map<string, double> params, vector<size_t> dates)
+        : Option(params), m_dates(dates) {}
+    // intrinsic value (undiscounted) of exercising at S
+    virtual Vec<double> intrinsic(const Vec<double>& S) const = 0;
+    // exercise dates on a grid of N_steps steps (sorted, always including maturity)
+    vector<size_t> exercise_dates(size_t N_steps) const;
+    // true if the option can be exercised at every step of the simulation grid
+    // (no exercise dates given)
+    bool american() const { return m_dates.empty(); }
+    // the payoff depends on the exercise policy, which needs a regression
     Vec<double> payoff(Matrix<double> S, Vec<double> DF) const override;
 };
 
+// American put (Bermudan if exercise dates are given)
+class AM_Put : public EarlyExercise {
+
+public:
+    // constructor
+    AM_Put(double K, vector<size_t> dates = {}) : EarlyExercise({{"K", K}}, dates) {
+        // check that K is positive
+        if (K < 0.0)
+            throw std::invalid_argument("K must be non-negative");
+    }
+    // intrinsic value of a put
+    Vec<double> intrinsic(const Vec<double>& S) const override;
+};
+
+// American call (Bermudan if exercise dates are given)
+class AM_Call : public EarlyExercise {
+
+public:
+    // constructor
+    AM_Call(double K, vector<size_t> dates = {}) : EarlyExercise({{"K", K}}, dates) {
+        // check that K is positive
+        if (K < 0.0)
+            throw std::invalid_argument("K must be non-negative");
+    }
+    // intrinsic value of a call
+    Vec<double> intrinsic(const Vec<double>& S) const override;
+};
+
 #endif // !#ifndef OPTION_HPP
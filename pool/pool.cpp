@@ -0,0 +1,50 @@
+#include "pool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t N_threads) {
+    // default to the number of hardware threads (at least one)
+    if (N_threads == 0)
+        N_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    m_workers.reserve(N_threads);
+    for (size_t i = 0; i < N_threads; i++)
+        m_workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    for (auto& worker : m_workers)
+        worker.join();
+}
+
+size_t ThreadPool::size() const {
+    return m_workers.size();
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::work() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            // wait for a task or for the shutdown
+            m_cv.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+            // exit only once the queue has been drained
+            if (m_stop && m_tasks.empty())
+                return;
+            task = std::move(m_tasks.front());
+            m_tasks.pop();
+        }
+        // exceptions are captured by the packaged task
+        task();
+    }
+}
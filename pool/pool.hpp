@@ -0,0 +1,75 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using std::vector;
+
+// persistent pool of worker threads fed from a single FIFO queue
+class ThreadPool {
+
+private:
+    // worker threads (started once, joined in the destructor)
+    vector<std::thread> m_workers;
+    // pending tasks
+    std::queue<std::function<void()>> m_tasks;
+    // synchronization of the queue
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    // set when the pool is shutting down
+    bool m_stop = false;
+
+    // loop run by each worker
+    void work();
+
+public:
+    // constructor (0 threads means one per hardware thread)
+    explicit ThreadPool(size_t N_threads = 0);
+    // the pool is neither copyable nor movable (workers hold a pointer to it)
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator = (const ThreadPool&) = delete;
+    // destructor (drains the queue and joins the workers)
+    ~ThreadPool();
+
+    // number of workers
+    size_t size() const;
+
+    // pool shared by the engines of the process (one worker per hardware
+    // thread, started on first use); a task running on it must not wait for
+    // other tasks of the same pool
+    static ThreadPool& shared();
+
+    // schedule a callable and return a future on its result
+    template <class F>
+    auto submit(F f) -> std::future<decltype(f())>;
+
+};
+
+template <class F>
+auto ThreadPool::submit(F f) -> std::future<decltype(f())> {
+
+    // wrap the callable in a shared packaged task (std::function must be copyable)
+    using result_type = decltype(f());
+    auto task = std::make_shared<std::packaged_task<result_type()>>(std::move(f));
+    std::future<result_type> result = task->get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stop)
+            throw std::runtime_error("ThreadPool::submit: pool is stopped");
+        m_tasks.emplace([task]() { (*task)(); });
+    }
+    m_cv.notify_one();
+
+    return result;
+}
+
+#endif // !#ifndef POOL_HPP
@@ -0,0 +1,39 @@
+#include "pricer.hpp"
+#include "LSM.hpp"
+#include "MC.hpp"
+#include "PDE.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+map<string, double> Pricer::price(Vec<double> DF, double S_0, double T, size_t N_sim,
+    size_t N_steps) {
+
+    if (DF.size() == 0)
+        throw std::invalid_argument("Pricer: no discount factors");
+
+    // one dimensional diffusion with a vanilla payoff: finite differences,
+    // which discount at the rate of the model, so only when the discount
+    // factor of maturity agrees with it (the other engines use DF as given)
+    bool consistent = std::abs(log(DF[DF.size()-1]) + (*m_model)["r"] * T) <= 1e-6;
+    if (PDE::supports(m_model, m_option) && consistent) {
+        m_engine = "PDE";
+        PDE pde = PDE(m_model, m_option);
+        return pde.price(S_0, T, N_steps);
+    }
+
+    // early exercise on any other model: regression
+    if (EarlyExercise* option = dynamic_cast<EarlyExercise*>(m_option)) {
+        m_engine = "LSM";
+        LSM lsm = LSM(m_model, option, 3, Basis::Laguerre, nullptr, 4096, m_seed);
+        return lsm.price(DF, S_0, T, N_sim, N_steps);
+    }
+
+    m_engine = "MC";
+    MC mc = MC(m_model, m_option);
+    return mc.price(DF, S_0, T, N_sim, N_steps);
+}
+
+string Pricer::engine() const {
+    return m_engine;
+}
@@ -0,0 +1,44 @@
+#ifndef PRICER_HPP
+#define PRICER_HPP
+
+#include <map>
+#include <random>
+#include <string>
+
+#include "model.hpp"
+#include "option.hpp"
+#include "vec.hpp"
+
+using std::map;
+using std::string;
+
+// front end choosing the engine from the product and the model: the PDE for
+// one factor Black-Scholes vanillas (european or with early exercise) whose
+// discount factor of maturity is exp(-r T), LSM for the other early exercise
+// options and MC for everything else
+class Pricer {
+
+private:
+    // model and option to price
+    Model* m_model;
+    Option* m_option;
+    // seed of the engines that derive their own streams (LSM)
+    std::mt19937::result_type m_seed;
+    // engine used by the last call to price
+    string m_engine;
+
+public:
+    // constructor
+    Pricer(Model* model, Option* option, std::mt19937::result_type seed = 42)
+        : m_model(model), m_option(option), m_seed(seed) {};
+
+    // compute the price and IC at 95% (N_sim is ignored by the PDE)
+    map<string, double> price(Vec<double> DF, double S_0, double T, size_t N_sim,
+        size_t N_steps);
+
+    // name of the engine used by the last call to price ("PDE", "LSM" or "MC")
+    string engine() const;
+
+};
+
+#endif // !#ifndef PRICER_HPP
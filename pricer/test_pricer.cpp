@@ -0,0 +1,105 @@
+// checks of the engine dispatch: a trade must be priced as the same contract
+// whichever engine the Pricer picks for it
+
+#include "pricer.hpp"
+
+#include <cmath>
+#include <iostream>
+
+static size_t failures = 0;
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        std::cout << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// discount factors of a grid of N_steps steps at the rate r
+static Vec<double> discounts(double r, double T, size_t N_steps) {
+    Vec<double> DF(N_steps);
+    for (size_t i = 0; i < N_steps; i++)
+        DF[i] = exp(-r * T * (i + 1) / N_steps);
+    return DF;
+}
+
+// american options across the switch between the PDE (DF consistent with the
+// rate of the model) and LSM (DF moved by 1e-5 relative): both exercise on the
+// steps of the grid, so the prices agree up to the Monte Carlo error
+static void check_american() {
+
+    BlackScholes model = BlackScholes(0.05, 0.2);
+    AM_Put put = AM_Put(100.0);
+    AM_Call call = AM_Call(100.0);
+    size_t N_sim = 100000;
+
+    struct Case {
+        string name;
+        Option* option;
+        size_t N_steps;
+    };
+    for (const Case& c : vector<Case>{
+        {"put, 1 step", &put, 1}, {"put, 10 steps", &put, 10},
+        {"put, 50 steps", &put, 50}, {"call, 10 steps", &call, 10}}) {
+
+        Pricer pricer = Pricer(&model, c.option);
+        Vec<double> DF = discounts(0.05, 1.0, c.N_steps);
+        double pde = pricer.price(DF, 100.0, 1.0, N_sim, c.N_steps)["mean"];
+        check(pricer.engine() == "PDE", c.name + ": PDE for consistent discount factors");
+
+        DF[c.N_steps - 1] *= 1.0 + 1e-5;
+        map<string, double> lsm = pricer.price(DF, 100.0, 1.0, N_sim, c.N_steps);
+        check(pricer.engine() == "LSM", c.name + ": LSM for other discount factors");
+
+        // two half widths of the interval (about 4 standard errors)
+        double tol = lsm["ub"] - lsm["lb"];
+        check(std::abs(pde - lsm["mean"]) <= tol, c.name + ": PDE " + std::to_string(pde)
+            + " and LSM " + std::to_string(lsm["mean"]) + " agree");
+    }
+
+    // a single exercise date is the european contract
+    Pricer pricer = Pricer(&model, &put);
+    double single = pricer.price(discounts(0.05, 1.0, 1), 100.0, 1.0, N_sim, 1)["mean"];
+    check(std::abs(single - model.european(100.0, 100.0, 1.0, false)) <= 2e-4,
+        "american put with one step is the european put");
+}
+
+// european options on the PDE against the closed form, and the strikes the
+// PDE cannot grid (K = 0) going to MC
+static void check_european() {
+
+    BlackScholes model = BlackScholes(0.05, 0.2);
+    Vec<double> DF = discounts(0.05, 1.0, 1);
+
+    for (double K : {80.0, 100.0, 120.0}) {
+        for (bool call : {true, false}) {
+            EU_Call eu_call = EU_Call(K);
+            EU_Put eu_put = EU_Put(K);
+            Option* option = call ? static_cast<Option*>(&eu_call) : &eu_put;
+            Pricer pricer = Pricer(&model, option);
+            double pde = pricer.price(DF, 100.0, 1.0, 1000, 1)["mean"];
+            string name = string(call ? "call" : "put") + " K=" + std::to_string(K);
+            check(pricer.engine() == "PDE", name + ": PDE");
+            check(std::abs(pde - model.european(100.0, K, 1.0, call)) <= 2e-4,
+                name + ": PDE " + std::to_string(pde) + " matches the closed form");
+        }
+    }
+
+    // a call struck at zero is the (discounted forward of the) spot
+    EU_Call zero = EU_Call(0.0);
+    Pricer pricer = Pricer(&model, &zero);
+    map<string, double> result = pricer.price(DF, 100.0, 1.0, 100000, 1);
+    check(pricer.engine() == "MC", "call K=0: MC");
+    check(std::abs(result["mean"] - 100.0) <= result["ub"] - result["lb"],
+        "call K=0: " + std::to_string(result["mean"]) + " is the spot");
+}
+
+int main() {
+    check_european();
+    check_american();
+    if (failures)
+        std::cout << failures << " check(s) failed" << std::endl;
+    else
+        std::cout << "all checks passed" << std::endl;
+    return failures ? 1 : 0;
+}
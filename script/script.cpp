@@ -0,0 +1,686 @@
+#include "script.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+typedef ScriptedOption::Instr Instr;
+typedef ScriptedOption::Op Op;
+
+// single pass compiler: recursive descent parser emitting the bytecode
+class ScriptCompiler {
+
+private:
+    // kind of the tokens
+    enum Kind { NUMBER, NAME, SYMBOL, END };
+
+    struct Token {
+        Kind kind;
+        string text;
+        double number;
+        size_t line;
+    };
+
+    // where the code runs (not all the variables are known everywhere)
+    enum Context { INIT, STEP, VALUE };
+
+    ScriptedOption& m_option;
+
+    // tokens of the source and position of the parser
+    vector<Token> m_tokens;
+    size_t m_pos = 0;
+
+    // registers of the names, of the constants and of the fixings
+    map<string, size_t> m_params;
+    map<string, size_t> m_states;
+    map<double, size_t> m_constants;
+    map<size_t, size_t> m_fixings;
+    // registers of temporaries that are free again
+    vector<size_t> m_free;
+    vector<bool> m_temp;
+    // registers that hold the same value on all the paths
+    vector<bool> m_uniform;
+
+    // code being emitted and its context
+    vector<Instr>* m_code = nullptr;
+    Context m_context = INIT;
+    // register of the mask of the enclosing if (0 outside of any if)
+    size_t m_mask = 0;
+    // true once the payoff is compiled
+    bool m_returned = false;
+
+    // errors point to the line of the current token
+    [[noreturn]] void error(const string& message) const {
+        throw std::invalid_argument("script line " + std::to_string(peek().line) + ": " + message);
+    }
+
+    void tokenize(const string& source) {
+        size_t line = 1;
+        size_t i = 0;
+        while (i < source.size()) {
+            char c = source[i];
+            if (c == '\n') {
+                line++;
+                i++;
+            }
+            else if (isspace(static_cast<unsigned char>(c)))
+                i++;
+            // comments run to the end of the line
+            else if (c == '#' || (c == '/' && i + 1 < source.size() && source[i+1] == '/')) {
+                while (i < source.size() && source[i] != '\n')
+                    i++;
+            }
+            else if (isdigit(static_cast<unsigned char>(c)) || c == '.') {
+                size_t end = 0;
+                double number;
+                try {
+                    number = std::stod(source.substr(i), &end);
+                } catch (const std::exception&) {
+                    throw std::invalid_argument("script line " + std::to_string(line)
+                        + ": malformed number");
+                }
+                m_tokens.push_back({NUMBER, source.substr(i, end), number, line});
+                i += end;
+            }
+            else if (isalpha(static_cast<unsigned char>(c)) || c == '_') {
+                size_t start = i;
+                while (i < source.size() && (isalnum(static_cast<unsigned char>(source[i]))
+                    || source[i] == '_'))
+                    i++;
+                m_tokens.push_back({NAME, source.substr(start, i - start), 0.0, line});
+            }
+            else {
+                // two character operators first
+                string two = source.substr(i, 2);
+                if (two == "<=" || two == ">=" || two == "==" || two == "!=" || two == "&&"
+                    || two == "||") {
+                    m_tokens.push_back({SYMBOL, two, 0.0, line});
+                    i += 2;
+                }
+                else if (string("+-*/<>!=(),;{}").find(c) != string::npos) {
+                    m_tokens.push_back({SYMBOL, string(1, c), 0.0, line});
+                    i++;
+                }
+                else
+                    throw std::invalid_argument("script line " + std::to_string(line)
+                        + ": unexpected character '" + string(1, c) + "'");
+            }
+        }
+        m_tokens.push_back({END, "", 0.0, line});
+    }
+
+    // token access
+    const Token& peek() const { return m_tokens[m_pos]; }
+    Token next() { return m_tokens[m_pos + 1 < m_tokens.size() ? m_pos++ : m_pos]; }
+    bool accept(const string& symbol) {
+        if (peek().kind == END || peek().kind == NUMBER || peek().text != symbol)
+            return false;
+        m_pos++;
+        return true;
+    }
+    void expect(const string& symbol) {
+        if (!accept(symbol))
+            error("expected '" + symbol + "'");
+    }
+    string name() {
+        if (peek().kind != NAME)
+            error("expected a name");
+        return next().text;
+    }
+    double number() {
+        bool negative = accept("-");
+        if (peek().kind != NUMBER)
+            error("expected a number");
+        return negative ? -next().number : next().number;
+    }
+    size_t index() {
+        double k = number();
+        if (k < 0.0 || k != std::floor(k))
+            error("step indices must be non-negative integers");
+        size_t i = static_cast<size_t>(k);
+        m_option.m_last = std::max(m_option.m_last, i);
+        return i;
+    }
+
+    // name of a new parameter or state (not a variable of the step, a function,
+    // a keyword or a name already declared)
+    string declared() {
+        static const vector<string> reserved = {
+            "S", "S_prev", "t", "dt", "DF", "step",
+            "abs", "exp", "log", "sqrt", "max", "min", "if",
+            "param", "state", "each", "at", "return", "else"
+        };
+        string id = name();
+        if (std::find(reserved.begin(), reserved.end(), id) != reserved.end())
+            error("'" + id + "' is reserved");
+        if (m_params.count(id) || m_states.count(id))
+            error("'" + id + "' is already declared");
+        return id;
+    }
+
+    // registers
+    size_t allocate() {
+        m_temp.push_back(false);
+        m_uniform.push_back(false);
+        return m_option.m_N_regs++;
+    }
+    size_t temporary() {
+        size_t r;
+        if (!m_free.empty()) {
+            r = m_free.back();
+            m_free.pop_back();
+        }
+        else
+            r = allocate();
+        m_temp[r] = true;
+        return r;
+    }
+    void release(size_t r) {
+        if (r < m_temp.size() && m_temp[r]) {
+            m_temp[r] = false;
+            m_free.push_back(r);
+        }
+    }
+    size_t constant(double value) {
+        auto it = m_constants.find(value);
+        if (it != m_constants.end())
+            return it->second;
+        size_t r = allocate();
+        m_uniform[r] = true;
+        m_constants[value] = r;
+        m_option.m_constants.push_back({r, value});
+        return r;
+    }
+
+    // append dst = op(a, b, c)
+    void push(Op op, size_t dst, size_t a, size_t b = 0, size_t c = 0) {
+        m_code->push_back({op, dst, a, b, c, m_uniform[a], m_uniform[b]});
+    }
+
+    // emit dst = op(a, b, c) into a new temporary (the operands are released
+    // first, an instruction may write over its own operands)
+    size_t emit(Op op, size_t a, size_t b = 0, size_t c = 0) {
+        // a product that is only used by a sum is fused with it
+        if (op == Op::ADD && !m_code->empty() && m_code->back().op == Op::MUL) {
+            Instr product = m_code->back();
+            bool used = product.dst == a || product.dst == b;
+            size_t other = product.dst == b ? a : b;
+            if (m_temp[product.dst] && used && other != product.dst) {
+                m_code->pop_back();
+                release(product.dst);
+                return emit(Op::MADD, product.a, product.b, other);
+            }
+        }
+        release(a);
+        release(b);
+        release(c);
+        size_t dst = temporary();
+        push(op, dst, a, b, c);
+        return dst;
+    }
+
+    // variables of the step
+    size_t variable(size_t r, const string& text) {
+        bool known = r == ScriptedOption::R_S
+            || (r == ScriptedOption::R_DF && m_context != INIT)
+            || m_context == STEP;
+        if (!known)
+            error("'" + text + "' is not known " + (m_context == INIT ? "at inception" : "at maturity"));
+        m_option.m_uses[r] = true;
+        return r;
+    }
+
+    // expressions (each returns the register of its value)
+    size_t primary() {
+        if (peek().kind == NUMBER)
+            return constant(next().number);
+        if (accept("(")) {
+            size_t r = expression();
+            expect(")");
+            return r;
+        }
+        string id = name();
+
+        // functions (and fixings)
+        if (accept("(")) {
+            if (id == "S") {
+                size_t k = index();
+                expect(")");
+                if (m_context == INIT && k != 0)
+                    error("only S(0) is known at inception");
+                if (k == 0 && m_context == INIT)
+                    return variable(ScriptedOption::R_S, id);
+                auto it = m_fixings.find(k);
+                if (it != m_fixings.end())
+                    return it->second;
+                size_t r = allocate();
+                m_fixings[k] = r;
+                m_option.m_fixings.push_back({r, k});
+                return r;
+            }
+
+            vector<size_t> args;
+            do
+                args.push_back(expression());
+            while (accept(","));
+            expect(")");
+
+            static const map<string, std::pair<Op, size_t>> functions = {
+                {"abs", {Op::ABS, 1}}, {"exp", {Op::EXP, 1}}, {"log", {Op::LOG, 1}},
+                {"sqrt", {Op::SQRT, 1}}, {"max", {Op::MAX, 2}}, {"min", {Op::MIN, 2}},
+                {"if", {Op::SEL, 3}}
+            };
+            auto it = functions.find(id);
+            if (it == functions.end())
+                error("unknown function '" + id + "'");
+            if (args.size() != it->second.second)
+                error(id + " takes " + std::to_string(it->second.second) + " arguments");
+            return emit(it->second.first, args[0], args.size() > 1 ? args[1] : 0,
+                args.size() > 2 ? args[2] : 0);
+        }
+
+        static const map<string, size_t> variables = {
+            {"S", ScriptedOption::R_S}, {"S_prev", ScriptedOption::R_S_PREV},
+            {"t", ScriptedOption::R_T}, {"dt", ScriptedOption::R_DT},
+            {"DF", ScriptedOption::R_DF}, {"step", ScriptedOption::R_STEP}
+        };
+        auto v = variables.find(id);
+        if (v != variables.end())
+            return variable(v->second, id);
+        auto p = m_params.find(id);
+        if (p != m_params.end())
+            return p->second;
+        auto s = m_states.find(id);
+        if (s != m_states.end())
+            return s->second;
+        error("unknown name '" + id + "'");
+    }
+
+    size_t unary() {
+        if (accept("-"))
+            return emit(Op::NEG, unary());
+        if (accept("!"))
+            return emit(Op::NOT, unary());
+        return primary();
+    }
+
+    size_t product() {
+        size_t r = unary();
+        while (true) {
+            if (accept("*"))
+                r = emit(Op::MUL, r, unary());
+            else if (accept("/"))
+                r = emit(Op::DIV, r, unary());
+            else
+                return r;
+        }
+    }
+
+    size_t sum() {
+        size_t r = product();
+        while (true) {
+            if (accept("+"))
+                r = emit(Op::ADD, r, product());
+            else if (accept("-"))
+                r = emit(Op::SUB, r, product());
+            else
+                return r;
+        }
+    }
+
+    size_t comparison() {
+        size_t r = sum();
+        static const map<string, Op> operators = {
+            {"<", Op::LT}, {"<=", Op::LE}, {">", Op::GT}, {">=", Op::GE},
+            {"==", Op::EQ}, {"!=", Op::NE}
+        };
+        for (const auto& op : operators)
+            if (accept(op.first))
+                return emit(op.second, r, sum());
+        return r;
+    }
+
+    size_t conjunction() {
+        size_t r = comparison();
+        while (accept("&&"))
+            r = emit(Op::AND, r, comparison());
+        return r;
+    }
+
+    size_t expression() {
+        size_t r = conjunction();
+        while (accept("||"))
+            r = emit(Op::OR, r, conjunction());
+        return r;
+    }
+
+    // statements
+    void assign(size_t dst, size_t r) {
+        if (m_mask)
+            // masked paths keep their value
+            push(Op::SEL, dst, m_mask, r, dst);
+        else if (r < m_temp.size() && m_temp[r] && !m_code->empty() && m_code->back().dst == r)
+            // the last instruction computed the value, let it write the state
+            m_code->back().dst = dst;
+        else
+            push(Op::MOV, dst, r);
+        release(r);
+    }
+
+    void statements() {
+        expect("{");
+        while (!accept("}")) {
+            if (peek().kind == END)
+                error("expected '}'");
+            statement();
+        }
+    }
+
+    void statement() {
+        if (accept("if")) {
+            expect("(");
+            size_t condition = expression();
+            expect(")");
+
+            // the paths that take each branch are those of the enclosing mask
+            // (which stays alive until the end of the enclosing if)
+            size_t outer = m_mask;
+            release(condition);
+            size_t taken = temporary();
+            if (outer)
+                push(Op::AND, taken, outer, condition);
+            else
+                push(Op::NE, taken, condition, constant(0.0));
+            m_mask = taken;
+            statements();
+            if (accept("else")) {
+                size_t other = temporary();
+                if (outer)
+                    push(Op::GT, other, outer, taken);
+                else
+                    push(Op::NOT, other, taken);
+                release(taken);
+                m_mask = other;
+                if (peek().kind == NAME && peek().text == "if")
+                    statement();
+                else
+                    statements();
+                release(other);
+            }
+            else
+                release(taken);
+            m_mask = outer;
+            return;
+        }
+
+        string id = name();
+        auto s = m_states.find(id);
+        if (s == m_states.end())
+            error("only states can be assigned, '" + id + "' is not a state");
+        expect("=");
+        size_t r = expression();
+        expect(";");
+        assign(s->second, r);
+    }
+
+    // declarations
+    void declaration() {
+        string keyword = name();
+
+        if (keyword == "param") {
+            string id = declared();
+            expect("=");
+            double value = number();
+            expect(";");
+            // a register of its own (not shared with an equal constant), so
+            // that the value can be changed without compiling again
+            size_t r = allocate();
+            m_uniform[r] = true;
+            m_option.m_constants.push_back({r, value});
+            m_params[id] = r;
+            m_option.m_declared.push_back({id, r});
+            m_option.m_params[id] = value;
+        }
+        else if (keyword == "state") {
+            string id = declared();
+            expect("=");
+            m_code = &m_option.m_init;
+            m_context = INIT;
+            size_t r = expression();
+            expect(";");
+            size_t dst = allocate();
+            assign(dst, r);
+            m_states[id] = dst;
+        }
+        else if (keyword == "each" || keyword == "at") {
+            ScriptedOption::Segment segment;
+            if (keyword == "at") {
+                do {
+                    size_t k = index();
+                    if (k == 0)
+                        error("steps are numbered from 1");
+                    segment.at.push_back(k);
+                } while (accept(","));
+            }
+            m_option.m_step.push_back(segment);
+            m_code = &m_option.m_step.back().code;
+            m_context = STEP;
+            statements();
+        }
+        else if (keyword == "return") {
+            if (m_returned)
+                error("the payoff is already returned");
+            m_code = &m_option.m_value;
+            m_context = VALUE;
+            m_option.m_payoff = expression();
+            expect(";");
+            m_returned = true;
+        }
+        else
+            error("expected param, state, each, at or return");
+    }
+
+public:
+    explicit ScriptCompiler(ScriptedOption& option)
+        : m_option(option), m_temp(ScriptedOption::R_FIXED, false),
+          m_uniform(ScriptedOption::R_FIXED, false) {
+        // the time, the discount factor and the index of the step
+        for (size_t r = ScriptedOption::R_T; r < ScriptedOption::R_FIXED; r++)
+            m_uniform[r] = true;
+    }
+
+    void compile(const string& source) {
+        tokenize(source);
+        while (peek().kind != END)
+            declaration();
+        if (!m_returned)
+            error("missing return");
+    }
+};
+
+ScriptedOption::ScriptedOption(const string& source, map<string, double> params)
+    : PathOption({}), m_N_regs(R_FIXED), m_uses(), m_last(0), m_payoff(R_S) {
+    ScriptCompiler(*this).compile(source);
+    set_params(params);
+}
+
+void ScriptedOption::set_params(const map<string, double>& params) {
+    for (const auto& kv : params) {
+        auto declared = std::find_if(m_declared.begin(), m_declared.end(),
+            [&kv](const std::pair<string, size_t>& p) { return p.first == kv.first; });
+        // values of undeclared parameters are most likely typos
+        if (declared == m_declared.end())
+            throw std::invalid_argument("script: no parameter named " + kv.first);
+        for (auto& c : m_constants)
+            if (c.first == declared->second)
+                c.second = kv.second;
+        m_params[kv.first] = kv.second;
+    }
+}
+
+vector<string> ScriptedOption::params() const {
+    vector<string> names;
+    for (const auto& p : m_declared)
+        names.push_back(p.first);
+    return names;
+}
+
+ScriptedOption ScriptedOption::with(const map<string, double>& params) const {
+    ScriptedOption option = *this;
+    option.set_params(params);
+    return option;
+}
+
+// loops of the instructions (one per arity, inlined in the interpreter)
+template <class F>
+static inline void apply(double* d, const double* a, size_t n, F f) {
+    for (size_t i = 0; i < n; i++)
+        d[i] = f(a[i]);
+}
+
+template <class F>
+static inline void apply(double* d, const double* a, const double* b, size_t n,
+    bool uniform_a, bool uniform_b, F f) {
+    if (uniform_b) {
+        double y = b[0];
+        for (size_t i = 0; i < n; i++)
+            d[i] = f(a[i], y);
+    }
+    else if (uniform_a) {
+        double x = a[0];
+        for (size_t i = 0; i < n; i++)
+            d[i] = f(x, b[i]);
+    }
+    else {
+        for (size_t i = 0; i < n; i++)
+            d[i] = f(a[i], b[i]);
+    }
+}
+
+void ScriptedOption::run(const vector<Instr>& code, double* state, const double* S,
+    const double* S_prev, size_t n) const {
+    for (size_t first = 0; first < n; first += m_chunk)
+        run(code, state, S, S_prev, n, first, std::min(m_chunk, n - first));
+}
+
+void ScriptedOption::run(const vector<Instr>& code, double* state, const double* S,
+    const double* S_prev, size_t n, size_t first, size_t m) const {
+
+    // registers of the chunk (the spots are not stored in the state)
+    auto reg = [&](size_t r) -> const double* {
+        return (r == R_S ? S : r == R_S_PREV ? S_prev : state + (r - R_T) * n) + first;
+    };
+
+    for (const Instr& in : code) {
+        double* d = state + (in.dst - R_T) * n + first;
+        const double* a = reg(in.a);
+        const double* b = reg(in.b);
+        switch (in.op) {
+        case MOV: apply(d, a, m, [](double x) { return x; }); break;
+        case NEG: apply(d, a, m, [](double x) { return -x; }); break;
+        case NOT: apply(d, a, m, [](double x) { return x == 0.0 ? 1.0 : 0.0; }); break;
+        case ABS: apply(d, a, m, [](double x) { return std::abs(x); }); break;
+        case EXP: apply(d, a, m, [](double x) { return exp(x); }); break;
+        case LOG: apply(d, a, m, [](double x) { return log(x); }); break;
+        case SQRT: apply(d, a, m, [](double x) { return sqrt(x); }); break;
+        case ADD: apply(d, a, b, m, in.uniform_a, in.uniform_b, [](double x, double y) { return x + y; }); break;
+        case SUB: apply(d, a, b, m, in.uniform_a, in.uniform_b, [](double x, double y) { return x - y; }); break;
+        case MUL: apply(d, a, b, m, in.uniform_a, in.uniform_b, [](double x, double y) { return x * y; }); break;
+        case DIV: apply(d, a, b, m, in.uniform_a, in.uniform_b, [](double x, double y) { return x / y; }); break;
+        case MIN: apply(d, a, b, m, in.uniform_a, in.uniform_b, [](double x, double y) { return std::min(x, y); }); break;
+        case MAX: apply(d, a, b, m, in.uniform_a, in.uniform_b, [](double x, double y) { return std::max(x, y); }); break;
+        case LT: apply(d, a, b, m, in.uniform_a, in.uniform_b, [](double x, double y) { return x < y ? 1.0 : 0.0; }); break;
+        case LE: apply(d, a, b, m, in.uniform_a, in.uniform_b, [](double x, double y) { return x <= y ? 1.0 : 0.0; }); break;
+        case GT: apply(d, a, b, m, in.uniform_a, in.uniform_b, [](double x, double y) { return x > y ? 1.0 : 0.0; }); break;
+        case GE: apply(d, a, b, m, in.uniform_a, in.uniform_b, [](double x, double y) { return x >= y ? 1.0 : 0.0; }); break;
+        case EQ: apply(d, a, b, m, in.uniform_a, in.uniform_b, [](double x, double y) { return x == y ? 1.0 : 0.0; }); break;
+        case NE: apply(d, a, b, m, in.uniform_a, in.uniform_b, [](double x, double y) { return x != y ? 1.0 : 0.0; }); break;
+        case AND: apply(d, a, b, m, in.uniform_a, in.uniform_b, [](double x, double y) {
+            return x != 0.0 && y != 0.0 ? 1.0 : 0.0; }); break;
+        case OR: apply(d, a, b, m, in.uniform_a, in.uniform_b, [](double x, double y) {
+            return x != 0.0 || y != 0.0 ? 1.0 : 0.0; }); break;
+        case MADD: {
+            const double* c = reg(in.c);
+            if (in.uniform_a || in.uniform_b) {
+                const double* v = in.uniform_a ? b : a;
+                double x = in.uniform_a ? a[0] : b[0];
+                for (size_t i = 0; i < m; i++)
+                    d[i] = x * v[i] + c[i];
+            }
+            else {
+                for (size_t i = 0; i < m; i++)
+                    d[i] = a[i] * b[i] + c[i];
+            }
+            break;
+        }
+        case SEL: {
+            const double* c = reg(in.c);
+            for (size_t i = 0; i < m; i++)
+                d[i] = a[i] != 0.0 ? b[i] : c[i];
+            break;
+        }
+        }
+    }
+}
+
+void ScriptedOption::init_block(double* state, const double* S_0, size_t n) const {
+
+    // constants and fixings (only S(0) is known at inception)
+    for (const auto& c : m_constants)
+        std::fill(state + (c.first - R_T) * n, state + (c.first - R_T + 1) * n, c.second);
+    for (const auto& f : m_fixings) {
+        double* fixing = state + (f.first - R_T) * n;
+        if (f.second == 0)
+            std::copy(S_0, S_0 + n, fixing);
+        else
+            std::fill(fixing, fixing + n, std::numeric_limits<double>::quiet_NaN());
+    }
+
+    // no step run yet
+    std::fill(state + (R_STEP - R_T) * n, state + (R_STEP - R_T + 1) * n, 0.0);
+
+    run(m_init, state, S_0, nullptr, n);
+}
+
+void ScriptedOption::update_block(double* state, const double* S_prev, const double* S_next,
+    size_t n, const Step& t) const {
+
+    // variables of the step that are read by the script (the index of the step
+    // is always kept, to check at maturity that the grid reached m_last)
+    const double values[R_FIXED] = {0.0, 0.0, t.t, t.dt, t.DF, double(t.i)};
+    for (size_t r = R_T; r < R_FIXED; r++)
+        if (m_uses[r] || r == R_STEP)
+            std::fill(state + (r - R_T) * n, state + (r - R_T + 1) * n, values[r]);
+
+    // fixings of the step, before the statements that may read them
+    for (const auto& f : m_fixings)
+        if (f.second == t.i)
+            std::copy(S_next, S_next + n, state + (f.first - R_T) * n);
+
+    for (const Segment& segment : m_step)
+        if (segment.at.empty()
+            || std::find(segment.at.begin(), segment.at.end(), t.i) != segment.at.end())
+            run(segment.code, state, S_next, S_prev, n);
+}
+
+void ScriptedOption::value_block(const double* state, const double* S_T, size_t n,
+    double DF_T, double* payoff) const {
+
+    // fixings and observation dates past the end of the grid would leave NaN
+    // or statements that never ran
+    size_t steps = n ? static_cast<size_t>(state[(R_STEP - R_T) * n]) : m_last;
+    if (steps < m_last)
+        throw std::invalid_argument("script: step " + std::to_string(m_last)
+            + " is past the last step of the grid (" + std::to_string(steps) + ")");
+
+    // the payoff needs temporaries, run it on a copy of the state
+    vector<double> regs(state, state + state_size() * n);
+    if (m_uses[R_DF])
+        std::fill(regs.begin() + (R_DF - R_T) * n, regs.begin() + (R_DF - R_T + 1) * n, DF_T);
+    run(m_value, regs.data(), S_T, nullptr, n);
+
+    const double* value = m_payoff == R_S ? S_T : regs.data() + (m_payoff - R_T) * n;
+    std::copy(value, value + n, payoff);
+}
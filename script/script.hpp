@@ -0,0 +1,149 @@
+#ifndef SCRIPT_HPP
+#define SCRIPT_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "option.hpp"
+
+using std::map;
+using std::string;
+using std::vector;
+
+// option whose payoff is written in a small scripting language, e.g. a cliquet
+//
+//   param L = 1;
+//   state sum = 0;
+//   each { sum = sum + DF * max(L * (S - S_prev), 0); }
+//   return sum;
+//
+// or a worst-of-three-dates digital with a knock-out
+//
+//   param K = 100;
+//   param B = 130;
+//   state alive = 1;
+//   each { if (S >= B) { alive = 0; } }
+//   return DF * alive * if(min(S(4), min(S(8), S(12))) > K, 1, 0);
+//
+// declarations (names must be declared before they are used, and cannot be
+// those of the variables, the functions or the keywords below):
+//   param name = number;      constant, can be overridden by the constructor
+//   state name = expr;        running state of each path, set at inception
+//   each { ... }              statements run at every step
+//   at k, l, ... { ... }      statements run at the steps of index k, l, ...
+//                             (pricing throws if the grid has fewer steps)
+//   return expr;              discounted payoff, from the state at maturity
+// statements are assignments to states (name = expr;) and if (cond) { ... }
+// else { ... }, which are run on every path with the assignments masked;
+// expressions have + - * / (unary -), comparisons, && || !, the functions
+// max, min, abs, exp, log, sqrt, if(cond, a, b) and the variables
+//   S        spot at the current step (at inception in state, at maturity in return)
+//   S_prev   spot at the previous step
+//   S(k)     fixing of the step of index k (NaN before that step, S(0) is the
+//            initial spot; pricing throws if the grid has fewer steps)
+//   t, dt    time of the step and its length
+//   step     index of the step (1 to N_steps)
+//   DF       discount factor of the step (of maturity in return)
+// comments start with // or # and run to the end of the line.
+//
+// The script is compiled once into the bytecode of a register machine whose
+// registers are columns of the block of paths, so that every instruction is a
+// tight loop over a few thousand paths and the dispatch is amortized.
+class ScriptedOption : public PathOption {
+
+public:
+    // operations of the register machine (dst = op(a, b, c), comparisons and
+    // logical operations give 1 or 0, MADD gives a * b + c, SEL gives b where a
+    // is non-zero else c)
+    enum Op : unsigned char {
+        MOV, NEG, NOT, ABS, EXP, LOG, SQRT,
+        ADD, SUB, MUL, DIV, MIN, MAX, LT, LE, GT, GE, EQ, NE, AND, OR,
+        MADD, SEL
+    };
+
+    // instruction of the register machine (operands that are the same on all
+    // the paths, constants and variables of the step, are read as scalars by
+    // the binary operations)
+    struct Instr {
+        Op op;
+        size_t dst;
+        size_t a;
+        size_t b;
+        size_t c;
+        bool uniform_a;
+        bool uniform_b;
+    };
+
+    // statements run at the steps of the given indices (every step if empty)
+    struct Segment {
+        vector<size_t> at;
+        vector<Instr> code;
+    };
+
+    // registers of the variables that are not states (the spots are read from
+    // the engine, the others are stored with the states)
+    enum Register : size_t { R_S, R_S_PREV, R_T, R_DT, R_DF, R_STEP, R_FIXED };
+
+private:
+    // number of paths run through the whole code at once (the registers of a
+    // chunk stay in the L1 cache between the instructions)
+    static constexpr size_t m_chunk = 256;
+
+    // number of registers (the first two are not stored in the state)
+    size_t m_N_regs;
+    // constant registers and their values
+    vector<std::pair<size_t, double>> m_constants;
+    // fixing registers and the index of their step
+    vector<std::pair<size_t, size_t>> m_fixings;
+    // variables of the step that are read by the script
+    bool m_uses[R_FIXED];
+    // declared parameters and their registers
+    vector<std::pair<string, size_t>> m_declared;
+    // last step read by the fixings and the observation dates (the grid must
+    // reach it, checked by value_block)
+    size_t m_last;
+
+    // code run at inception, at the steps and at maturity
+    vector<Instr> m_init;
+    vector<Segment> m_step;
+    vector<Instr> m_value;
+    // register of the payoff after m_value
+    size_t m_payoff;
+
+    // run code on a block of n paths
+    void run(const vector<Instr>& code, double* state, const double* S,
+        const double* S_prev, size_t n) const;
+    // run code on the paths [first, first + m) of a block of n paths
+    void run(const vector<Instr>& code, double* state, const double* S,
+        const double* S_prev, size_t n, size_t first, size_t m) const;
+
+    // set the values of declared parameters (throws for undeclared names)
+    void set_params(const map<string, double>& params);
+
+    friend class ScriptCompiler;
+
+public:
+    // constructor (compiles the script, the declared parameters can be
+    // overridden by params; throws std::invalid_argument on errors)
+    ScriptedOption(const string& source, map<string, double> params = {});
+
+    // names of the parameters declared by the script
+    vector<string> params() const;
+
+    // copy of the compiled script with other values of the declared parameters
+    // (no parsing: the parameters are registers of their own)
+    ScriptedOption with(const map<string, double>& params) const;
+
+    // kernels of the path functional (the state of a block is stored one
+    // register after the other, n doubles each)
+    size_t state_size() const override { return m_N_regs - R_T; }
+    bool reads_time() const override { return m_uses[R_T] || m_uses[R_DT]; }
+    void init_block(double* state, const double* S_0, size_t n) const override;
+    void update_block(double* state, const double* S_prev, const double* S_next,
+        size_t n, const Step& t) const override;
+    void value_block(const double* state, const double* S_T, size_t n, double DF_T,
+        double* payoff) const override;
+};
+
+#endif // !#ifndef SCRIPT_HPP
@@ -0,0 +1,246 @@
+// checks of the payoff scripts: the scripted versions of the streaming options
+// must reproduce them path by path, and the compiler features (masked
+// assignments, fused multiply-adds, reuse of the temporaries, writes to the
+// assigned state, fixings and parameters) must match a plain C++ evaluation
+
+#include "script.hpp"
+#include "MC.hpp"
+
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+
+static size_t failures = 0;
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        std::cout << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// same payoffs up to rounding (the compiler may contract a * b + c)
+static bool same(const Vec<double>& a, const Vec<double>& b) {
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++)
+        if (!(std::abs(a[i] - b[i]) <= 1e-12 * std::max(1.0, std::abs(b[i]))))
+            return false;
+    return true;
+}
+
+// paths given by rows of spots (one row per path, S_0 first)
+static Matrix<double> paths(const vector<vector<double>>& rows) {
+    Matrix<double> S(rows.size(), rows[0].size());
+    for (size_t i = 0; i < rows.size(); i++)
+        for (size_t j = 0; j < rows[i].size(); j++)
+            S[j][i] = rows[i][j];
+    return S;
+}
+
+// scripts against the hand written streaming options
+static void check_options() {
+
+    BlackScholes model = BlackScholes(0.05, 0.2);
+    size_t N_sim = 10000, N_steps = 50;
+    double T = 1.0;
+    Vec<double> DF(N_steps);
+    for (size_t i = 0; i < N_steps; i++)
+        DF[i] = exp(-0.05 * T * (i + 1) / N_steps);
+
+    ClOption cliquet = ClOption(0.5);
+    AS_Call asian = AS_Call(100.0);
+    LB_Call lookback = LB_Call();
+    UO_Call up_out = UO_Call(100.0, 130.0);
+
+    struct Case {
+        string name;
+        PathOption* option;
+        string source;
+        map<string, double> params;
+    };
+    vector<Case> cases = {
+        {"cliquet", &cliquet,
+            "param L = 1; state sum = 0;\n"
+            "each { sum = sum + DF * max(L * (S - S_prev), 0); }\n"
+            "return sum;", {{"L", 0.5}}},
+        {"asian", &asian,
+            "param K = 100; state sum = 0; state n = 0;\n"
+            "each { sum = sum + S; n = n + 1; }\n"
+            "return DF * max(sum / n - K, 0);", {}},
+        {"lookback", &lookback,
+            "state m = S; each { m = min(m, S); } return DF * (S - m);", {}},
+        {"up-and-out", &up_out,
+            "param K = 100; param B = 130; state alive = if(S < B, 1, 0);\n"
+            "each { if (S >= B) { alive = 0; } }\n"
+            "return DF * alive * max(S - K, 0);", {}},
+    };
+
+    for (const Case& c : cases) {
+        ScriptedOption script = ScriptedOption(c.source, c.params);
+
+        // on stored paths (a single block)
+        Model::seed(7);
+        MC mc = MC(&model, c.option);
+        Matrix<double> S = mc.simulate(N_sim, N_steps, 100.0, T);
+        check(same(script.payoff(S, DF, T), c.option->payoff(S, DF, T)),
+            c.name + " on stored paths");
+
+        // streamed by the engine (blocks that are not a multiple of the chunks)
+        MC scripted = MC(&model, &script);
+        Model::seed(11);
+        Vec<double> expected = mc.payoffs(DF, 100.0, T, N_sim, N_steps);
+        Model::seed(11);
+        check(same(scripted.payoffs(DF, 100.0, T, N_sim, N_steps), expected),
+            c.name + " streamed");
+    }
+}
+
+// compiler features against a plain evaluation of the same statements
+static void check_compiler() {
+
+    vector<vector<double>> rows = {
+        {100, 95, 110, 80, 120},
+        {100, 100, 85, 120, 91},
+        {100, 130, 70, 100, 100},
+        {100, 101, 99, 102, 98}
+    };
+    Matrix<double> S = paths(rows);
+    size_t N_steps = 4;
+    Vec<double> DF(N_steps, 0.9);
+
+    auto evaluate = [&](std::function<double(const vector<double>&)> f) {
+        Vec<double> payoff(rows.size());
+        for (size_t i = 0; i < rows.size(); i++)
+            payoff[i] = f(rows[i]);
+        return payoff;
+    };
+
+    // masked assignments in nested if / else if / else
+    ScriptedOption masks = ScriptedOption(
+        "param K = 100; state c = 0; state d = 0;\n"
+        "each {\n"
+        "  if (S > K) { c = c + 1; if (S > 115) { d = d + 10; } else { d = d + 1; } }\n"
+        "  else if (S > 90) { c = c + 0.5; }\n"
+        "  else { c = c - 1; d = d - 100; }\n"
+        "}\n"
+        "return c + d;");
+    check(same(masks.payoff(S, DF, 1.0), evaluate([](const vector<double>& s) {
+        double c = 0.0, d = 0.0;
+        for (size_t j = 1; j < s.size(); j++) {
+            if (s[j] > 100) { c += 1; d += s[j] > 115 ? 10 : 1; }
+            else if (s[j] > 90) { c += 0.5; }
+            else { c -= 1; d -= 100; }
+        }
+        return c + d;
+    })), "masked if / else if / else");
+
+    // fused multiply-adds (also with the spot, register 0, as the addend),
+    // assignments that read the assigned state and deep expressions that
+    // reuse the temporaries
+    ScriptedOption fused = ScriptedOption(
+        "state x = 0; state y = 1;\n"
+        "each {\n"
+        "  x = S + 2 * x;\n"
+        "  y = y * 2 + y - x / (1 + abs(x));\n"
+        "  x = (S - 1) * (S + 1) + x - x + (x * x - x * x) + ((S * 2) - (S + S));\n"
+        "}\n"
+        "return DF * x + -S / 2 + 3 * (4 + S) + y + if(S > 100 && !(S < 0) || 0, 1, -1);");
+    check(same(fused.payoff(S, DF, 1.0), evaluate([](const vector<double>& s) {
+        double x = 0.0, y = 1.0;
+        for (size_t j = 1; j < s.size(); j++) {
+            x = s[j] + 2 * x;
+            y = y * 2 + y - x / (1 + std::abs(x));
+            x = (s[j] - 1) * (s[j] + 1);
+        }
+        double S_T = s.back();
+        return 0.9 * x - S_T / 2 + 3 * (4 + S_T) + y + (S_T > 100 ? 1 : -1);
+    })), "fused multiply-adds and temporaries");
+
+    // fixings (read at and after their step, NaN before) and observation dates
+    ScriptedOption fixings = ScriptedOption(
+        "state early = 0; state c = 0;\n"
+        "at 1 { early = if(S(2) == S(2), 1, 0); }\n"
+        "at 2, 4 { c = c + S(2) * step; }\n"
+        "return S(0) + 1000 * S(3) + c + early;");
+    check(same(fixings.payoff(S, DF, 1.0), evaluate([](const vector<double>& s) {
+        return s[0] + 1000 * s[3] + s[2] * 2 + s[2] * 4;
+    })), "fixings and observation dates");
+
+    // parameters do not share their register with equal literals, and with()
+    // leaves the original untouched
+    ScriptedOption params = ScriptedOption("param K = 100; return 100 + K + S;");
+    ScriptedOption other = params.with({{"K", 50.0}});
+    check(same(params.payoff(S, DF, 1.0), evaluate([](const vector<double>& s) {
+        return 200 + s.back();
+    })), "default parameters");
+    check(same(other.payoff(S, DF, 1.0), evaluate([](const vector<double>& s) {
+        return 150 + s.back();
+    })), "parameters set by with()");
+    check(other["K"] == 50.0 && params["K"] == 100.0, "parameter getters");
+
+    // scripts that read the time need the grid of the stored paths
+    ScriptedOption timed = ScriptedOption("state x = 0; each { x = x + dt; } return x;");
+    bool refused = false;
+    try {
+        const Option& option = timed;
+        option.payoff(S, DF);
+    } catch (const std::logic_error&) {
+        refused = true;
+    }
+    check(refused && !params.reads_time(), "payoff without the time grid");
+    check(same(timed.payoff(S, DF, 2.0), Vec<double>(rows.size(), 2.0)),
+        "time of the steps from the maturity");
+
+    // errors
+    for (const string source : {
+        "return x;", "state a = S(3); return a;", "each { S = 1; } return 0;",
+        "return t;", "param K = 1; return K", "return max(1);", "return 1; return 2;",
+        "state a = 1; return a; $", "state a = 1;", "at 0 { } return 1;",
+        "state S = 5; return S;", "param dt = 1; return dt;", "state max = 1; return 1;",
+        "state at = 1; return 1;", "param a = 1; state a = 2; return a;"}) {
+        bool thrown = false;
+        try {
+            ScriptedOption option = ScriptedOption(source);
+        } catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        check(thrown, "error for '" + source + "'");
+    }
+    // fixings and observation dates past the end of the grid (4 steps)
+    for (const string source : {
+        "param K = 100; return DF * max(S(8) - K, 0);",
+        "state x = 0; at 2, 12 { x = S; } return x;"}) {
+        ScriptedOption option = ScriptedOption(source);
+        bool thrown = false;
+        try {
+            option.payoff(S, DF, 1.0);
+        } catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        check(thrown, "error on 4 steps for '" + source + "'");
+    }
+    ScriptedOption last = ScriptedOption("state x = 0; at 4 { x = S(4); } return x;");
+    check(same(last.payoff(S, DF, 1.0), evaluate([](const vector<double>& s) {
+        return s[4];
+    })), "fixing and date on the last step");
+
+    bool thrown = false;
+    try {
+        ScriptedOption option = ScriptedOption("param K = 1; return K;", {{"k", 1.0}});
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    check(thrown, "error for an undeclared parameter");
+}
+
+int main() {
+    check_options();
+    check_compiler();
+    if (failures)
+        std::cout << failures << " check(s) failed" << std::endl;
+    else
+        std::cout << "all checks passed" << std::endl;
+    return failures ? 1 : 0;
+}
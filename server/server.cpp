@@ -0,0 +1,333 @@
+#include "server.hpp"
+#include "pricer.hpp"
+#include "script.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using clock_type = std::chrono::steady_clock;
+
+// milliseconds elapsed between two instants
+static double elapsed_ms(clock_type::time_point start, clock_type::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+PricingRequest PricingRequest::parse(const string& line) {
+
+    PricingRequest request;
+    std::istringstream tokens(line);
+    string token;
+
+    while (tokens >> token) {
+        // every token is of the form key=value
+        size_t eq = token.find('=');
+        if (eq == string::npos || eq == 0 || eq + 1 == token.size())
+            throw std::invalid_argument("malformed token '" + token + "'");
+        string key = token.substr(0, eq);
+        string value = token.substr(eq + 1);
+
+        if (key == "id")
+            request.id = value;
+        else if (key == "model")
+            request.model = value;
+        else if (key == "option")
+            request.option = value;
+        else if (key == "script")
+            request.script = value;
+        else if (key == "DF") {
+            // comma separated list of discount factors
+            std::istringstream list(value);
+            string item;
+            while (std::getline(list, item, ','))
+                request.DF.push_back(std::stod(item));
+        }
+        else {
+            size_t end = 0;
+            double number = std::stod(value, &end);
+            if (end != value.size())
+                throw std::invalid_argument("field " + key + " is not a number");
+            request.params[key] = number;
+        }
+    }
+
+    if (request.model.empty())
+        throw std::invalid_argument("missing model");
+    if (request.option.empty())
+        throw std::invalid_argument("missing option");
+    if (request.DF.empty())
+        throw std::invalid_argument("missing DF");
+
+    return request;
+}
+
+double PricingRequest::get(const string& key, double default_value) const {
+    auto it = params.find(key);
+    return it == params.end() ? default_value : it->second;
+}
+
+double PricingRequest::get(const string& key) const {
+    auto it = params.find(key);
+    if (it == params.end())
+        throw std::invalid_argument("missing " + key);
+    return it->second;
+}
+
+std::unique_ptr<Model> make_model(const PricingRequest& request) {
+    if (request.model == "BlackScholes")
+        return std::make_unique<BlackScholes>(request.get("r"), request.get("sigma"),
+            request.get("d", 0.0));
+    if (request.model == "Merton")
+        return std::make_unique<Merton>(request.get("r"), request.get("sigma"),
+            request.get("lambda"), request.get("mu_J"), request.get("sigma_J"),
+            request.get("d", 0.0));
+    if (request.model == "Heston")
+        return std::make_unique<Heston>(request.get("r"), request.get("kappa"),
+            request.get("theta"), request.get("xi"), request.get("rho"), request.get("v0"),
+            request.get("d", 0.0));
+    throw std::invalid_argument("unknown model " + request.model);
+}
+
+std::shared_ptr<const ScriptedOption> ScriptLibrary::get(const string& name) {
+
+    if (m_dir.empty())
+        throw std::invalid_argument("scripts are disabled (no script directory)");
+    // a plain file name, so that no request reads outside of the directory
+    bool plain = !name.empty() && name[0] != '.' && std::all_of(name.begin(), name.end(),
+        [](char c) { return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '.'; });
+    if (!plain)
+        throw std::invalid_argument("invalid script name '" + name + "'");
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_scripts.find(name);
+    if (it != m_scripts.end())
+        return it->second;
+
+    std::ifstream file(m_dir + "/" + name);
+    if (!file)
+        throw std::invalid_argument("cannot read the script '" + name + "'");
+    std::ostringstream source;
+    source << file.rdbuf();
+    auto script = std::make_shared<const ScriptedOption>(source.str());
+    m_scripts[name] = script;
+    return script;
+}
+
+std::unique_ptr<Option> make_option(const PricingRequest& request, ScriptLibrary* scripts) {
+    if (request.option == "EU_Call")
+        return std::make_unique<EU_Call>(request.get("K"));
+    if (request.option == "EU_Put")
+        return std::make_unique<EU_Put>(request.get("K"));
+    if (request.option == "ClOption")
+        return std::make_unique<ClOption>(request.get("L"));
+    if (request.option == "AM_Call")
+        return std::make_unique<AM_Call>(request.get("K"));
+    if (request.option == "AM_Put")
+        return std::make_unique<AM_Put>(request.get("K"));
+    if (request.option == "AS_Call")
+        return std::make_unique<AS_Call>(request.get("K"));
+    if (request.option == "LB_Call")
+        return std::make_unique<LB_Call>();
+    if (request.option == "UO_Call")
+        return std::make_unique<UO_Call>(request.get("K"), request.get("B"));
+    if (request.option == "Script") {
+        if (!scripts)
+            throw std::invalid_argument("scripts are disabled");
+        std::shared_ptr<const ScriptedOption> script = scripts->get(request.script);
+        // the request also carries the model fields, keep the declared parameters
+        map<string, double> params;
+        for (const string& name : script->params())
+            if (request.params.count(name))
+                params[name] = request.params.at(name);
+        return std::make_unique<ScriptedOption>(script->with(params));
+    }
+    throw std::invalid_argument("unknown option " + request.option);
+}
+
+map<string, double> PricingServer::price(const PricingRequest& request, string* engine) {
+
+    std::unique_ptr<Model> model = make_model(request);
+    std::unique_ptr<Option> option = make_option(request, &m_scripts);
+
+    double S_0 = request.get("S_0");
+    double T = request.get("T");
+    double N_sim = request.get("N_sim");
+    double N_steps = request.get("N_steps", 1.0);
+    if (!(N_sim >= 2.0 && N_steps >= 1.0))
+        throw std::invalid_argument("N_sim must be at least 2 and N_steps at least 1");
+
+    // every request reseeds the worker that runs it, so that the draws never
+    // depend on the requests the worker ran before: from seed= if given (the
+    // result is then reproducible), else from the number of the request (each
+    // unseeded request has its own stream, but which number it gets depends
+    // on the order in which the workers pick the requests)
+    std::mt19937::result_type seed;
+    if (request.params.count("seed")) {
+        seed = static_cast<std::mt19937::result_type>(request.get("seed"));
+    } else {
+        std::seed_seq derived = {size_t(42), m_requests++};
+        derived.generate(&seed, &seed + 1);
+    }
+    Model::seed(seed);
+
+    // the engine is chosen from the product and the model
+    Pricer pricer = Pricer(model.get(), option.get(), seed);
+    map<string, double> results = pricer.price(request.DF, S_0, T,
+        static_cast<size_t>(N_sim), static_cast<size_t>(N_steps));
+    if (engine)
+        *engine = pricer.engine();
+    return results;
+}
+
+void PricingServer::serve(std::function<bool(string&)> read_line,
+    std::function<void(const string&)> write_line) {
+
+    // results are written by the workers, one line at a time
+    std::mutex output;
+    auto write = [&output, &write_line](const string& line) {
+        std::lock_guard<std::mutex> lock(output);
+        write_line(line);
+    };
+
+    vector<std::future<void>> pending;
+    string line;
+    size_t count = 0;
+
+    while (read_line(line)) {
+        // skip blank lines and comments
+        if (line.find_first_not_of(" \t\r") == string::npos || line[0] == '#')
+            continue;
+
+        clock_type::time_point received = clock_type::now();
+        string fallback_id = std::to_string(count++);
+
+        pending.push_back(m_pool.submit([this, line, received, fallback_id, &write]() {
+            clock_type::time_point started = clock_type::now();
+            std::ostringstream out;
+            out.precision(10);
+            string id = fallback_id;
+            try {
+                PricingRequest request = PricingRequest::parse(line);
+                if (!request.id.empty())
+                    id = request.id;
+                string engine;
+                map<string, double> results = price(request, &engine);
+                clock_type::time_point done = clock_type::now();
+                out << "id=" << id << " status=ok engine=" << engine;
+                for (const string key : {"mean", "lb", "ub", "var"})
+                    out << " " << key << "=" << results[key];
+                out << " queue_ms=" << elapsed_ms(received, started)
+                    << " compute_ms=" << elapsed_ms(started, done)
+                    << " latency_ms=" << elapsed_ms(received, done);
+            } catch (const std::exception& e) {
+                out << "id=" << id << " status=error"
+                    << " latency_ms=" << elapsed_ms(received, clock_type::now())
+                    << " message=\"" << e.what() << "\"";
+            }
+            write(out.str());
+        }));
+
+        // forget the requests that are already done
+        pending.erase(std::remove_if(pending.begin(), pending.end(),
+            [](std::future<void>& f) {
+                return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+            }), pending.end());
+    }
+
+    // wait for the requests still in flight before returning
+    for (auto& f : pending)
+        f.get();
+}
+
+void PricingServer::serve(std::istream& is, std::ostream& os) {
+    serve([&is](string& line) { return static_cast<bool>(std::getline(is, line)); },
+        [&os](const string& line) { os << line << std::endl; });
+}
+
+void PricingServer::serve_socket(const string& path) {
+
+    // create the listening socket
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw std::runtime_error("PricingServer::serve_socket: cannot create socket");
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::invalid_argument("PricingServer::serve_socket: path too long");
+    path.copy(address.sun_path, path.size());
+
+    // remove a stale socket left by a previous run
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(fd, 16) < 0) {
+        close(fd);
+        throw std::runtime_error("PricingServer::serve_socket: cannot listen on " + path);
+    }
+
+    // every client gets its own reader, so that an idle connection does not
+    // hold back the others (the requests of all the clients share the pool)
+    while (true) {
+        int client = accept(fd, nullptr, nullptr);
+        if (client < 0)
+            continue;
+        std::thread([this, client]() { serve_client(client); }).detach();
+    }
+}
+
+void PricingServer::serve_client(int client) {
+
+    string buffer;
+    auto read_line = [client, &buffer](string& line) {
+        size_t eol;
+        while ((eol = buffer.find('\n')) == string::npos) {
+            char chunk[4096];
+            ssize_t n = read(client, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                // end of the connection: return the last unterminated line
+                if (buffer.empty())
+                    return false;
+                line.swap(buffer);
+                buffer.clear();
+                return true;
+            }
+            buffer.append(chunk, n);
+        }
+        line = buffer.substr(0, eol);
+        buffer.erase(0, eol + 1);
+        return true;
+    };
+    // a client that hangs up before its results are written must not kill the
+    // server: no SIGPIPE, and the remaining results are dropped
+    bool gone = false;
+    auto write_line = [client, &gone](const string& line) {
+        string message = line + "\n";
+        size_t sent = 0;
+        while (!gone && sent < message.size()) {
+            ssize_t n = send(client, message.data() + sent, message.size() - sent,
+                MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                gone = true;
+                break;
+            }
+            sent += n;
+        }
+    };
+
+    serve(read_line, write_line);
+    close(client);
+}
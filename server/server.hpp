@@ -0,0 +1,113 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "model.hpp"
+#include "option.hpp"
+#include "pool.hpp"
+
+using std::map;
+using std::string;
+using std::vector;
+
+// a single pricing request, parsed from one line of "key=value" tokens, e.g.
+// id=1 model=BlackScholes r=0.05 sigma=0.2 option=EU_Call K=100 S_0=100 T=1 DF=0.95 N_sim=10000 N_steps=1
+struct PricingRequest {
+    // identifier echoed back with the result
+    string id;
+    // name of the model and of the option
+    string model;
+    string option;
+    // name of the payoff script in the script directory of the server
+    // (option=Script, the numeric fields override the parameters it declares)
+    string script;
+    // numeric fields (model and option parameters, S_0, T, N_sim, ...)
+    map<string, double> params;
+    // discount factors (comma separated in the message)
+    vector<double> DF;
+
+    // parse a request from a line (throws std::invalid_argument on malformed input)
+    static PricingRequest parse(const string& line);
+
+    // numeric field, with a default if it is missing
+    double get(const string& key, double default_value) const;
+    // numeric field, throws if it is missing
+    double get(const string& key) const;
+};
+
+class ScriptedOption;
+
+// payoff scripts of a directory, each compiled once on first use: requests name
+// a file of the directory, never a path (a script edited after its first use
+// is not read again)
+class ScriptLibrary {
+
+private:
+    // directory of the scripts (empty: scripts are disabled)
+    string m_dir;
+    // compiled scripts by name
+    std::mutex m_mutex;
+    map<string, std::shared_ptr<const ScriptedOption>> m_scripts;
+
+public:
+    // constructor
+    explicit ScriptLibrary(string dir = "") : m_dir(dir) {};
+
+    // compiled script (throws std::invalid_argument if scripts are disabled,
+    // the name is not a plain file name or the script does not compile)
+    std::shared_ptr<const ScriptedOption> get(const string& name);
+
+};
+
+// build the model and the option described by a request (scripted options
+// come from scripts, if given)
+std::unique_ptr<Model> make_model(const PricingRequest& request);
+std::unique_ptr<Option> make_option(const PricingRequest& request,
+    ScriptLibrary* scripts = nullptr);
+
+// long-running pricing service: requests are scheduled on a persistent pool of
+// workers and results are streamed back (one line each) as soon as they finish
+class PricingServer {
+
+private:
+    // warm workers shared by all the requests
+    ThreadPool m_pool;
+    // payoff scripts that the requests can price
+    ScriptLibrary m_scripts;
+    // number of the requests priced without a seed (each gets its own stream)
+    std::atomic<size_t> m_requests{0};
+
+    // serve requests from a line reader, writing results with a line writer
+    void serve(std::function<bool(string&)> read_line,
+        std::function<void(const string&)> write_line);
+    // serve the requests of a connected socket until it is closed (then closes it)
+    void serve_client(int client);
+
+public:
+    // constructor (0 threads means one per hardware thread; scripts are only
+    // read from script_dir, and disabled without one)
+    explicit PricingServer(size_t N_threads = 0, string script_dir = "")
+        : m_pool(N_threads), m_scripts(script_dir) {};
+
+    // price a single request on the calling thread (the name of the engine
+    // that was used is stored in engine, if given)
+    map<string, double> price(const PricingRequest& request, string* engine = nullptr);
+
+    // serve line-delimited requests until the end of the input stream
+    void serve(std::istream& is, std::ostream& os);
+
+    // serve line-delimited requests from the clients of a Unix domain socket
+    // (each connection is read by a thread of its own, never returns)
+    void serve_socket(const string& path);
+
+};
+
+#endif // !#ifndef SERVER_HPP